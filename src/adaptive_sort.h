@@ -0,0 +1,104 @@
+#ifndef ADAPTIVE_SORT_H
+#define ADAPTIVE_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+/* constants */
+#define ADAPTIVE_SORT_MAX_MOVES_PER_ITEM  8  // insertion sort gives up after n * this many moves
+#define ADAPTIVE_SORT_RADIX_BITS          8
+
+
+/* macros */
+// Generates a stable sort for arrays that are usually already sorted, in the
+// spirit of klib's KSORT_INIT:
+//     ADAPTIVE_SORT_INIT(name, type_t, key)  // uint32_t key(const type_t*)
+//     bool adaptive_sort_name(type_t* a, size_t n);
+//
+// Sorted input costs one scan. Nearly sorted input is fixed by insertion sort,
+// which is O(n) while the number of displaced items stays small. Anything else
+// gets an LSD radix sort on the keys, which skips the bytes every key shares.
+// Equal keys keep their order, so the result only depends on the input.
+// Returns false if the radix buffer could not be allocated (the array is then
+// partially sorted, still a permutation of the input).
+#define ADAPTIVE_SORT_INIT(name, type_t, key)                                                   \
+    static inline bool adaptive_sort_insertion_##name(type_t* a, size_t n, size_t first) {      \
+        size_t budget = n * ADAPTIVE_SORT_MAX_MOVES_PER_ITEM;                                   \
+        for (size_t i = first; i < n; i++) {                                                    \
+            uint32_t k = key(&a[i]);                                                            \
+            if (key(&a[i - 1]) <= k)                                                            \
+                continue;                                                                       \
+                                                                                                \
+            type_t item = a[i];                                                                 \
+            size_t j = i;                                                                       \
+            for (; j > 0 && key(&a[j - 1]) > k; j--)                                            \
+                a[j] = a[j - 1];                                                                \
+            a[j] = item;                                                                        \
+                                                                                                \
+            if (i - j > budget)                                                                 \
+                return false;                                                                   \
+            budget -= i - j;                                                                    \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static inline bool adaptive_sort_radix_##name(type_t* a, size_t n) {                        \
+        enum { BUCKETS = 1 << ADAPTIVE_SORT_RADIX_BITS };                                       \
+        type_t* buffer = (type_t*)malloc(n * sizeof(type_t));                                   \
+        if (buffer == NULL)                                                                     \
+            return false;                                                                       \
+                                                                                                \
+        type_t* src = a;                                                                        \
+        type_t* dst = buffer;                                                                   \
+        for (int shift = 0; shift < 32; shift += ADAPTIVE_SORT_RADIX_BITS) {                    \
+            size_t counts[BUCKETS] = {0};                                                       \
+            for (size_t i = 0; i < n; i++)                                                      \
+                counts[(key(&src[i]) >> shift) & (BUCKETS - 1)]++;                              \
+            if (counts[(key(&src[0]) >> shift) & (BUCKETS - 1)] == n)                           \
+                continue;  /* every key has the same digit */                                   \
+                                                                                                \
+            size_t offset = 0;                                                                  \
+            for (int b = 0; b < BUCKETS; b++) {                                                 \
+                size_t count = counts[b];                                                       \
+                counts[b] = offset;                                                             \
+                offset += count;                                                                \
+            }                                                                                   \
+            for (size_t i = 0; i < n; i++)                                                      \
+                dst[counts[(key(&src[i]) >> shift) & (BUCKETS - 1)]++] = src[i];                \
+                                                                                                \
+            type_t* t = src;                                                                    \
+            src = dst;                                                                          \
+            dst = t;                                                                            \
+        }                                                                                       \
+                                                                                                \
+        if (src != a)                                                                           \
+            memcpy(a, src, n * sizeof(type_t));                                                 \
+        free(buffer);                                                                           \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static inline bool adaptive_sort_##name(type_t* a, size_t n) {                              \
+        size_t i = 1;                                                                           \
+        while (i < n && key(&a[i - 1]) <= key(&a[i]))                                           \
+            i++;                                                                                \
+        if (i >= n)                                                                             \
+            return true;                                                                        \
+                                                                                                \
+        if (adaptive_sort_insertion_##name(a, n, i))                                            \
+            return true;                                                                        \
+        return adaptive_sort_radix_##name(a, n);                                                \
+    }
+
+
+/* function declarations */
+// Maps a signed integer to an unsigned key with the same order
+static inline uint32_t adaptive_sort_int_key(int32_t i) {
+    return (uint32_t)i ^ 0x80000000u;
+}
+
+
+#endif
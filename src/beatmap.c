@@ -18,47 +18,31 @@
 #include <stdio.h>
 #include <time.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <humanize.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <kvec.h>
-#include <khash.h>
-#include <ksort.h>
-#include <ini.h>
 
 #include "util.h"
+#include "chunk_reader.h"
+#include "paths.h"
+#include "osz.h"
+#include "lexer.h"
+#include "cache.h"
+#include "osu_keys.h"
+#include "adaptive_sort.h"
 
 
 /* constants */
-// Calculated using kh_str_hash_func("Whatever")
-// SECTION_NULL is triggered for "osu file format vXX"
-#define SECTION_NULL           0
-#define SECTION_GENERAL        1584505032
-#define SECTION_METADATA       -385360049
-#define SECTION_DIFFICULTY     -472001573
-#define SECTION_EVENTS         2087505209
-#define SECTION_TIMING_POINTS  -442323475
-#define SECTION_HITOBJECTS     -1760687583
-#define KEY_AUDIO_FILENAME     -1868215331
-#define KEY_AUDIO_LEAD_IN      1895414007
-#define KEY_PREVIEW_TIME       376647317
-#define KEY_MODE               2403779
-#define KEY_TITLE              80818744
-#define KEY_TITLE_UNICODE      607220101
-#define KEY_ARTIST             1969736551
-#define KEY_ARTIST_UNICODE     -1526467210
-#define KEY_CREATOR            -1601759220
-#define KEY_VERSION            2016261304
-#define KEY_SOURCES            -1812638661
-#define KEY_TAGS               2598969
-#define KEY_BEATMAP_ID         215463265
-#define KEY_BEATMAPSET_ID      -2099647785
-#define KEY_HP                 -1604895024
-#define KEY_CS                 882574609
-#define KEY_OD                 955053000
-#define KEY_AR                 -1015867192
-#define KEY_SV                 -215404126
+#define MAX_LINE_PARAMS        32
+#define MAX_PARSE_WORKERS      16
+#define PROGRESS_INTERVAL      4096  // lines between progress updates and cancellation checks
+#define CACHE_LINE_SIZE        64
+#define HASH_CHUNK_SIZE        16384
 
 
 /* macros */
@@ -68,70 +52,179 @@
 
 
 /* types */
+// Listed before parsing, the contents are only read by the worker that parses the file
 typedef struct {
-    char* data;
-    size_t size;
     char name[256];
+    char path[512];  // entry name for .osz
+    size_t size;
 } file_t;
 
 typedef kvec_t(file_t) beatmapset_files_t;
 
+// Shared by the parse workers and read by beatmap_load_task_poll()
 typedef struct {
-    beatmap_t*      beatmap;
-    difficulty_t*   difficulty;
-} ini_callback_args_t;
+    atomic_size_t   bytes_read;
+    atomic_size_t   bytes_total;
+    atomic_int      difficulties_parsed;
+    atomic_int      difficulty_count;
+    atomic_bool     is_cancelled;
+} load_progress_t;
+
+struct beatmap_load_task_t {
+    pthread_t       thread;
+    char            path[1024];
+    bool            is_metadata_only;
+    beatmap_t       beatmap;
+    error_t         error;
+    load_progress_t progress;
+    atomic_int      state;
+};
 
+typedef struct {
+    beatmap_t*              beatmap;
+    difficulty_t*           difficulty;
+    timing_point_cursor_t   tm_cursor;  // hit objects are mostly in time order
+    load_progress_t*        progress;  // NULL when loading a body
+    size_t                  bytes_reported;
+    bool                    is_out_of_memory;
+} parse_context_t;
+
+typedef struct {
+    file_t*         file;
+    beatmap_t       beatmap;  // receives set-wide metadata, merged after all jobs are done
+    difficulty_t    difficulty;
+    bool            is_parsed;
+    bool            is_out_of_memory;  // not the file's fault, so not cached as rejected
+    size_t          bytes_reported;
+} parse_job_t;
+
+typedef struct {
+    parse_job_t*    jobs;
+    parse_job_t**   order;  // largest file first
+    int             count;
+    osz_t*          archive;
+    region_t*       region;
+    bool            is_metadata_only;
+    load_progress_t* progress;
+    atomic_int      next;
+} parse_queue_t;
 
-/* local functions */
-static error_t      load_files(beatmapset_files_t* files, const char* path);
-static bool         parse_difficulty(file_t* file, beatmap_t* beatmap, difficulty_t* difficulty);
-static int          ini_callback(void* user, const char* section, const char* line, int lineno);
-static const char*  skip_space(const char* s);
-static bool         sort_hitobjects(hitobject_t a, hitobject_t b);
-static bool         sort_timing_points(timing_point_t a, timing_point_t b);
 
-KSORT_INIT(hitobject_t, hitobject_t, sort_hitobjects);
-KSORT_INIT(timing_point_t, timing_point_t, sort_timing_points);
+static atomic_int worker_limit = 0;
+
+
+/* local functions */
+static error_t      load(beatmap_t* beatmap, const char* path, bool is_metadata_only, load_progress_t* progress);
+static void*        load_task(void* user);
+static void         init_progress(load_progress_t* progress);
+static bool         is_cancelled(load_progress_t* progress);
+static error_t      load_files(beatmapset_files_t* files, beatmap_t* beatmap, const char* path);
+static error_t      load_archive_files(beatmapset_files_t* files, osz_t* archive);
+static void         unload_files(beatmapset_files_t* files);
+static error_t      open_source(chunk_reader_t* reader, osz_t* archive, const char* path, size_t offset);
+static error_t      hash_source(osz_t* archive, const char* path, uint64_t* hash, size_t* size);
+static error_t      get_source_size(osz_t* archive, const char* path, size_t* size);
+static error_t      parse_files(beatmapset_files_t* files, beatmap_t* beatmap, bool is_metadata_only, load_progress_t* progress);
+static void*        parse_worker(void* user);
+static void         finish_job(parse_queue_t* queue, parse_job_t* job);
+static int          get_worker_count(int job_count);
+static bool         parse_difficulty(file_t* file, chunk_reader_t* reader, size_t size, region_t* region, parse_job_t* job, load_progress_t* progress, bool is_metadata_only);
+static bool         parse_sections(parse_context_t* ctx, chunk_reader_t* reader, bool is_metadata_only);
+static bool         sort_difficulty(difficulty_t* difficulty);
+static bool         parse_line(parse_context_t* ctx, osu_section_t section, span_t line, int lineno);
+static int          find_timing_point(const timing_point_t* tms, int count, ms_t time);
+static int          compare_files_by_name(const void* a, const void* b);
+static int          compare_jobs_by_size(const void* a, const void* b);
+static size_t       align_up(size_t size);
+static uint32_t     hitobject_key(const hitobject_t* ho);
+static uint32_t     timing_point_key(const timing_point_t* tm);
+
+ADAPTIVE_SORT_INIT(hitobjects, hitobject_t, hitobject_key)
+ADAPTIVE_SORT_INIT(timing_points, timing_point_t, timing_point_key)
 
 
 error_t beatmap_load(beatmap_t* beatmap, const char* path) {
-    assert(beatmap != NULL);
-    assert(path != NULL);
+    load_progress_t progress;
+    init_progress(&progress);
+    return load(beatmap, path, false, &progress);
+}
 
-    beatmapset_files_t files;
+error_t beatmap_load_metadata(beatmap_t* beatmap, const char* path) {
+    load_progress_t progress;
+    init_progress(&progress);
+    return load(beatmap, path, true, &progress);
+}
 
-    memset(beatmap, 0, sizeof(beatmap_t));
+void beatmap_set_worker_count(int count) {
+    assert(count >= 0);
 
-    LOGF("loading beatmap \"%s\" ...", path);
-    CHECK_ERROR_LOG_PROPAGATE(load_files(&files, path), "Failed to load beatmap files");
+    atomic_store(&worker_limit, count);
+}
 
-    LOG("parsing beatmap ...");
-    for (int i = 0; i < kv_size(files); i++) {
-        difficulty_t diff;
-        if (parse_difficulty(&kv_A(files, i), beatmap, &diff)) {
-            kv_push(difficulty_t, beatmap->difficulties, diff);
-        }
+beatmap_load_task_t* beatmap_load_async(const char* path, bool is_metadata_only) {
+    assert(path != NULL);
+
+    beatmap_load_task_t* task = calloc(1, sizeof(beatmap_load_task_t));
+    if (task == NULL)
+        return NULL;
+
+    STRCP(task->path, path);
+    task->is_metadata_only = is_metadata_only;
+    init_progress(&task->progress);
+    atomic_init(&task->state, BEATMAP_LOAD_RUNNING);
+
+    if (pthread_create(&task->thread, NULL, load_task, task) != 0) {
+        free(task);
+        return NULL;
     }
+    return task;
+}
+
+beatmap_load_state_t beatmap_load_task_poll(beatmap_load_task_t* task, beatmap_load_progress_t* progress) {
+    assert(task != NULL);
 
-    for (int i = 0; i < kv_size(files); i++) {
-        free(kv_A(files, i).data);
+    if (progress) {
+        progress->bytes_read = atomic_load(&task->progress.bytes_read);
+        progress->bytes_total = atomic_load(&task->progress.bytes_total);
+        progress->difficulties_parsed = atomic_load(&task->progress.difficulties_parsed);
+        progress->difficulty_count = atomic_load(&task->progress.difficulty_count);
     }
+    return atomic_load(&task->state);
+}
 
-    return ERROR_SUCCESS;
+void beatmap_load_task_cancel(beatmap_load_task_t* task) {
+    assert(task != NULL);
+
+    atomic_store(&task->progress.is_cancelled, true);
 }
 
-void beatmap_destroy(beatmap_t* beatmap) {
+error_t beatmap_load_task_finish(beatmap_load_task_t* task, beatmap_t* beatmap) {
+    assert(task != NULL);
     assert(beatmap != NULL);
 
-    if (kv_size(beatmap->difficulties)) {
-        for (int i = 0; i < kv_size(beatmap->difficulties); i++) {
-            difficulty_t* d = &kv_A(beatmap->difficulties, i);
+    pthread_join(task->thread, NULL);
 
-            if (kv_size(d->timing_points))  kv_destroy(d->timing_points);
-            if (kv_size(d->hitobjects))     kv_destroy(d->hitobjects);
-        }
+    error_t err = task->error;
+    if (err == ERROR_SUCCESS)
+        *beatmap = task->beatmap;
+    else
+        memset(beatmap, 0, sizeof(beatmap_t));
 
-        kv_destroy(beatmap->difficulties);
+    free(task);
+    return err;
+}
+
+void beatmap_destroy(beatmap_t* beatmap) {
+    assert(beatmap != NULL);
+
+    region_destroy(beatmap->region);
+    beatmap->region = NULL;
+    kv_init(beatmap->difficulties);
+
+    if (beatmap->archive) {
+        osz_close(beatmap->archive);
+        free(beatmap->archive);
+        beatmap->archive = NULL;
     }
 }
 
@@ -152,13 +245,19 @@ void beatmap_debug_print(beatmap_t* beatmap) {
             "\tid: %d\n"
             "\tname: %s\n"
             "\taudio: %s\n"
+            "\tpreview: %d\n"
+            "\tHP: %.1f\n"
             "\tCS: %.1f\n"
+            "\tOD: %.1f\n"
             "\tSV: %.1f\n",
             i,
             d->id,
             d->name,
             d->audio_filename,
+            d->preview_time,
+            d->HP,
             d->CS,
+            d->OD,
             d->SV
         );
 
@@ -167,7 +266,7 @@ void beatmap_debug_print(beatmap_t* beatmap) {
         LOGF_DESC("\tTiming points[%lu]:", kv_size(d->timing_points));
         for (int j = 0; j < MIN(MAX_OBJECTS_SHOWN, kv_size(d->timing_points)); j++) {
             timing_point_t* tm = &kv_A(d->timing_points, j);
-            LOGF_DESC("\t\tTM[%d] at %f SV=%f BPM=%f", j, tm->time, tm->SV, tm->BPM);
+            LOGF_DESC("\t\tTM[%d] at %d SV=%f BPM=%f", j, tm->time, tm->SV, tm->BPM);
         }
         if (kv_size(d->timing_points) > MAX_OBJECTS_SHOWN)
             LOG_DESC("\t\t...");
@@ -175,66 +274,290 @@ void beatmap_debug_print(beatmap_t* beatmap) {
         LOGF_DESC("\tHit objects[%lu]:", kv_size(d->hitobjects));
         for (int j = 0; j < MIN(MAX_OBJECTS_SHOWN, kv_size(d->hitobjects)); j++) {
             hitobject_t* ho = &kv_A(d->hitobjects, j);
-            LOGF_DESC("\t\tHO[%d] at %f to %f COL=%d", j, ho->start_time, ho->end_time, ho->column);
+            LOGF_DESC("\t\tHO[%d] at %d to %d COL=%d", j, ho->start_time, ho->end_time, ho->column);
         }
         if (kv_size(d->hitobjects) > MAX_OBJECTS_SHOWN)
             LOG_DESC("\t\t...");
     }
 }
 
-timing_point_t* difficulty_get_timing_point_for_time(difficulty_t* difficulty, seconds_t time) {
+error_t difficulty_load_body(beatmap_t* beatmap, difficulty_t* difficulty) {
+    assert(beatmap != NULL);
+    assert(difficulty != NULL);
+
+    if (difficulty->is_body_loaded)
+        return ERROR_SUCCESS;
+
+    uint64_t hash = 0;
+    size_t size;
+    if (cache_is_enabled()) {
+        CHECK_ERROR_PROPAGATE(hash_source(beatmap->archive, difficulty->path, &hash, &size));
+    }
+    else {
+        CHECK_ERROR_PROPAGATE(get_source_size(beatmap->archive, difficulty->path, &size));
+    }
+
+    if (size != difficulty->source_size) {
+        LOGF("\"%s\" was modified since its metadata was loaded", difficulty->file_name);
+        return ERROR_INVALID_FORMAT;
+    }
+
+    // Set-wide fields are the same in every difficulty of a set, the cache gets them from `beatmap`
+    beatmap_t set = { .id = beatmap->id };
+    STRCP(set.title, beatmap->title);
+
+    difficulty_t d = *difficulty;
+    bool is_rejected = false;
+    if (cache_load(hash, size, &set, &d, &is_rejected) == ERROR_SUCCESS) {
+        if (is_rejected)
+            return ERROR_INVALID_FORMAT;
+    }
+    else {
+        chunk_reader_t reader;
+        CHECK_ERROR_PROPAGATE(open_source(&reader, beatmap->archive, difficulty->path, difficulty->body_offset));
+        reader.lexer.lineno = difficulty->body_lineno;
+
+        parse_context_t ctx = { &set, &d };
+        bool is_parsed = parse_sections(&ctx, &reader, false);
+        chunk_reader_close(&reader);
+
+        if (!is_parsed) {
+            region_kv_destroy(d.region, d.timing_points);
+            region_kv_destroy(d.region, d.hitobjects);
+            return (ctx.is_out_of_memory) ? (ERROR_UNDEFINED) : (ERROR_INVALID_FORMAT);
+        }
+        if (!sort_difficulty(&d)) {
+            region_kv_destroy(d.region, d.timing_points);
+            region_kv_destroy(d.region, d.hitobjects);
+            return ERROR_UNDEFINED;
+        }
+        cache_store(hash, size, &set, &d, false);
+
+        LOGF("parsed body of \"%s\"", d.file_name);
+    }
+
+    difficulty->timing_points = d.timing_points;
+    difficulty->hitobjects = d.hitobjects;
+    difficulty->is_body_loaded = true;
+    difficulty_build_hitobject_arrays(difficulty);
+    return ERROR_SUCCESS;
+}
+
+timing_point_t* difficulty_get_timing_point_for_time(difficulty_t* difficulty, ms_t time) {
     int i = difficulty_get_timing_point_index_for_time(difficulty, time);
     return (i >= 0) ? &kv_A(difficulty->timing_points, i) : NULL;
 }
 
-int difficulty_get_timing_point_index_for_time(difficulty_t* difficulty, seconds_t time) {
+int difficulty_get_timing_point_index_for_time(difficulty_t* difficulty, ms_t time) {
     assert(difficulty != NULL);
 
-    if (kv_size(difficulty->timing_points) == 0)
-        return -1;
+    return find_timing_point(difficulty->timing_points.a, kv_size(difficulty->timing_points), time);
+}
+
+int difficulty_seek_timing_point(difficulty_t* difficulty, timing_point_cursor_t* cursor, ms_t time) {
+    assert(difficulty != NULL);
+    assert(cursor != NULL);
 
-    int i = 0;
-    for (; i < kv_size(difficulty->timing_points); i++) {
-        timing_point_t* tm = &kv_A(difficulty->timing_points, i);
+    const timing_point_t* tms = difficulty->timing_points.a;
+    int count = kv_size(difficulty->timing_points);
+    int i = MIN(cursor->index, count - 1);
 
-        if (tm->time > time)
-            return i - 1;
+    // Going back in time is rare (seeking, unsorted input), start over
+    if (i >= 0 && tms[i].time > time) {
+        cursor->index = find_timing_point(tms, i, time);
+        return cursor->index;
     }
 
+    // Usually the next object is within the same timing point or the one after
+    i = MAX(i, -1);
+    while (i + 1 < count && tms[i + 1].time <= time)
+        i++;
+
+    cursor->index = i;
     return i;
 }
 
-error_t load_files(beatmapset_files_t* files, const char* path) {
-    assert(files != NULL);
+seconds_t ms_to_seconds(ms_t ms) {
+    // Dividing in double rounds once, converting `ms` to float first loses precision after ~4.6 hours
+    return (seconds_t)(ms / 1000.0);
+}
+
+ms_t seconds_to_ms(seconds_t seconds) {
+    return (ms_t)lround(seconds * 1000.0);
+}
+
+error_t difficulty_build_hitobject_arrays(difficulty_t* difficulty) {
+    assert(difficulty != NULL);
+
+    hitobject_arrays_t* arrays = &difficulty->hitobject_arrays;
+    region_free(difficulty->region, arrays->memory);
+    memset(arrays, 0, sizeof(hitobject_arrays_t));
+
+    size_t count = kv_size(difficulty->hitobjects);
+    if (count == 0)
+        return ERROR_SUCCESS;
+
+    // Counting pass, the columns are known before anything is allocated
+    uint32_t counts[UINT8_MAX + 1] = {0};
+    int column_count = MAX((int)difficulty->CS, 1);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t column = (uint8_t)kv_A(difficulty->hitobjects, i).column;
+        counts[column]++;
+        column_count = MAX(column_count, column + 1);
+    }
+
+    size_t time_size = align_up(count * sizeof(ms_t));
+    size_t column_size = align_up(count);
+    size_t offsets_size = align_up((column_count + 1) * sizeof(uint32_t));
+    size_t by_column_size = align_up(count * sizeof(uint32_t));
+    arrays->memory = region_alloc(difficulty->region, 2 * time_size + column_size + offsets_size + by_column_size + CACHE_LINE_SIZE - 1);
+    if (arrays->memory == NULL) {
+        LOGF("out of memory while splitting the hit objects of \"%s\"", difficulty->file_name);
+        return ERROR_UNDEFINED;
+    }
+
+    char* p = (char*)align_up((size_t)arrays->memory);
+    arrays->count = count;
+    arrays->start = (ms_t*)p;
+    arrays->end = (ms_t*)(p += time_size);
+    arrays->column = (uint8_t*)(p += time_size);
+    arrays->column_count = column_count;
+    arrays->column_offsets = (uint32_t*)(p += column_size);
+    arrays->by_column = (uint32_t*)(p += offsets_size);
+
+    uint32_t offset = 0;
+    for (int k = 0; k < column_count; k++) {
+        arrays->column_offsets[k] = offset;
+        offset += counts[k];
+        counts[k] = arrays->column_offsets[k];
+    }
+    arrays->column_offsets[column_count] = offset;
+
+    // Scatter pass, objects are visited in time order so each column stays sorted
+    for (size_t i = 0; i < count; i++) {
+        const hitobject_t* ho = &kv_A(difficulty->hitobjects, i);
+        arrays->start[i] = ho->start_time;
+        arrays->end[i] = ho->end_time;
+        arrays->column[i] = (uint8_t)ho->column;
+        arrays->by_column[counts[arrays->column[i]]++] = (uint32_t)i;
+    }
+    return ERROR_SUCCESS;
+}
+
+error_t load(beatmap_t* beatmap, const char* path, bool is_metadata_only, load_progress_t* progress) {
+    assert(beatmap != NULL);
     assert(path != NULL);
+    assert(progress != NULL);
 
-    kv_init(*files);
+    beatmapset_files_t files;
 
-    if (DirectoryExists(path)) {
-        FilePathList fs = LoadDirectoryFilesEx(path, ".osu", ERROR_UNDEFINED);
-        for (int i = 0; i < fs.count; i++) {
-            file_t f;
+    memset(beatmap, 0, sizeof(beatmap_t));
 
-            FILE *file = fopen(fs.paths[i], "rb");
+    LOGF("loading beatmap \"%s\" ...", path);
+    CHECK_ERROR_LOG_PROPAGATE(load_files(&files, beatmap, path), "Failed to load beatmap files");
+
+    beatmap->region = region_create();
+    if (beatmap->region == NULL) {
+        unload_files(&files);
+        if (beatmap->archive) {
+            osz_close(beatmap->archive);
+            free(beatmap->archive);
+            beatmap->archive = NULL;
+        }
+        LOG("failed to create the beatmap region");
+        return ERROR_UNDEFINED;
+    }
 
-            fseek(file, 0, SEEK_END);
-            f.size = ftell(file) + 1;
-            fseek(file, 0, SEEK_SET);
+    size_t total_size = 0;
+    for (int i = 0; i < kv_size(files); i++)
+        total_size += kv_A(files, i).size;
+    atomic_store(&progress->bytes_total, total_size);
+    atomic_store(&progress->difficulty_count, (int)kv_size(files));
+
+    LOGF("parsing beatmap%s ...", (is_metadata_only) ? (" metadata") : (""));
+    error_t err = parse_files(&files, beatmap, is_metadata_only, progress);
+    unload_files(&files);
+    if (err != ERROR_SUCCESS) {
+        beatmap_destroy(beatmap);
+        return err;
+    }
 
-            f.data = malloc(f.size);
-            size_t count = fread(f.data, 1, f.size, file);
-            f.data[count] = '\0';
+    if (is_cancelled(progress)) {
+        LOGF("cancelled loading \"%s\"", path);
+        beatmap_destroy(beatmap);
+        return ERROR_CANCELLED;
+    }
 
-            strncpy(f.name, GetFileName(fs.paths[i]), ARRAY_LENGTH(f.name));
+    return ERROR_SUCCESS;
+}
 
-            if (f.data == NULL || f.size == 0) {
-                LOGF("Could not read \"%s\"", fs.paths[i]);
-                return ERROR_UNDEFINED;
-            }
+void* load_task(void* user) {
+    beatmap_load_task_t* task = (beatmap_load_task_t*)user;
 
+    task->error = load(&task->beatmap, task->path, task->is_metadata_only, &task->progress);
+
+    beatmap_load_state_t state = BEATMAP_LOAD_DONE;
+    if (task->error == ERROR_CANCELLED)
+        state = BEATMAP_LOAD_CANCELLED;
+    else if (task->error != ERROR_SUCCESS)
+        state = BEATMAP_LOAD_FAILED;
+    atomic_store(&task->state, state);
+
+    return NULL;
+}
+
+void init_progress(load_progress_t* progress) {
+    atomic_init(&progress->bytes_read, 0);
+    atomic_init(&progress->bytes_total, 0);
+    atomic_init(&progress->difficulties_parsed, 0);
+    atomic_init(&progress->difficulty_count, 0);
+    atomic_init(&progress->is_cancelled, false);
+}
+
+bool is_cancelled(load_progress_t* progress) {
+    return progress && atomic_load_explicit(&progress->is_cancelled, memory_order_relaxed);
+}
+
+error_t load_files(beatmapset_files_t* files, beatmap_t* beatmap, const char* path) {
+    assert(files != NULL);
+    assert(beatmap != NULL);
+    assert(path != NULL);
+
+    kv_init(*files);
+
+    // Also runs on loader threads, so none of raylib's file helpers are used.
+    // Difficulties in subfolders belong to the set too.
+    if (path_is_directory(path)) {
+        path_list_t paths;
+        CHECK_ERROR_PROPAGATE(path_list_tree(&paths, path, ".osu"));
+        for (int i = 0; i < kv_size(paths); i++) {
+            file_t f = {
+                .size = path_get_size(kv_A(paths, i)),
+            };
+            STRCP(f.name, path_get_file_name(kv_A(paths, i)));
+            STRCP(f.path, kv_A(paths, i));
             kv_push(file_t, *files, f);
 
-            LOGF("loaded \"%s\" (%s)", GetFileName(fs.paths[i]), humanize_bytesize(f.size));
+            LOGF("found \"%s\" (%s)", f.name, humanize_bytesize(f.size));
+        }
+        path_list_destroy(&paths);
+    }
+    else if (path_has_extension(path, ".osz")) {
+        beatmap->archive = malloc(sizeof(osz_t));
+        if (beatmap->archive == NULL) {
+            LOG("out of memory while opening the archive");
+            return ERROR_UNDEFINED;
+        }
+
+        error_t err = osz_open(beatmap->archive, path);
+        if (err == ERROR_SUCCESS)
+            err = load_archive_files(files, beatmap->archive);
+
+        if (err != ERROR_SUCCESS) {
+            osz_close(beatmap->archive);
+            free(beatmap->archive);
+            beatmap->archive = NULL;
+            return err;
         }
     }
     else {
@@ -242,6 +565,9 @@ error_t load_files(beatmapset_files_t* files, const char* path) {
         return ERROR_FILE_NOT_FOUND;
     }
 
+    // readdir() order is filesystem dependent
+    qsort(files->a, kv_size(*files), sizeof(file_t), compare_files_by_name);
+
     size_t total_size = 0;
     for (int i = 0; i < kv_size(*files); i++)
         total_size += kv_A(*files, i).size;
@@ -250,211 +576,563 @@ error_t load_files(beatmapset_files_t* files, const char* path) {
     return ERROR_SUCCESS;
 }
 
-bool parse_difficulty(file_t* file, beatmap_t* beatmap, difficulty_t* difficulty) {
-    assert(file != NULL);
+error_t load_archive_files(beatmapset_files_t* files, osz_t* archive) {
+    assert(files != NULL);
+    assert(archive != NULL);
+
+    // Difficulties are inflated one at a time by the parse workers, audio and images
+    // stay compressed until requested
+    for (int i = 0; i < kv_size(archive->entries); i++) {
+        osz_entry_t* entry = &kv_A(archive->entries, i);
+        if (!path_has_extension(entry->name, ".osu"))
+            continue;
+
+        file_t f = {
+            .size = entry->size,
+        };
+        STRCP(f.name, path_get_file_name(entry->name));
+        STRCP(f.path, entry->name);
+        kv_push(file_t, *files, f);
+
+        LOGF("found \"%s\" (%s)", f.name, humanize_bytesize(f.size));
+    }
+
+    return ERROR_SUCCESS;
+}
+
+void unload_files(beatmapset_files_t* files) {
+    assert(files != NULL);
+
+    kv_destroy(*files);
+    kv_init(*files);
+}
+
+error_t open_source(chunk_reader_t* reader, osz_t* archive, const char* path, size_t offset) {
+    assert(reader != NULL);
+    assert(path != NULL);
+
+    // Both go through a fixed window, so memory use does not depend on the file size
+    if (archive) {
+        int index = osz_find_entry(archive, path);
+        if (index < 0)
+            return ERROR_FILE_NOT_FOUND;
+        return chunk_reader_open_entry(reader, archive, index, offset);
+    }
+    return chunk_reader_open(reader, path, offset);
+}
+
+error_t hash_source(osz_t* archive, const char* path, uint64_t* hash, size_t* size) {
+    assert(path != NULL);
+    assert(hash != NULL);
+    assert(size != NULL);
+
+    // The cache lookup needs the hash before parsing, so a miss reads the file twice
+    if (archive == NULL)
+        return cache_hash_file(path, hash, size);
+
+    int index = osz_find_entry(archive, path);
+    if (index < 0)
+        return ERROR_FILE_NOT_FOUND;
+
+    osz_reader_t reader;
+    CHECK_ERROR_PROPAGATE(osz_reader_open(&reader, archive, index));
+
+    char buffer[HASH_CHUNK_SIZE];
+    size_t read;
+    error_t err;
+    *hash = cache_hash(NULL, 0);
+    *size = 0;
+    while ((err = osz_reader_read(&reader, buffer, sizeof(buffer), &read)) == ERROR_SUCCESS && read > 0) {
+        *hash = cache_hash_update(*hash, buffer, read);
+        *size += read;
+    }
+
+    osz_reader_close(&reader);
+    return err;
+}
+
+error_t get_source_size(osz_t* archive, const char* path, size_t* size) {
+    assert(path != NULL);
+    assert(size != NULL);
+
+    if (archive) {
+        int index = osz_find_entry(archive, path);
+        if (index < 0)
+            return ERROR_FILE_NOT_FOUND;
+        *size = kv_A(archive->entries, index).size;
+        return ERROR_SUCCESS;
+    }
+
+    if (!path_is_file(path))
+        return ERROR_FILE_NOT_FOUND;
+    *size = path_get_size(path);
+    return ERROR_SUCCESS;
+}
+
+error_t parse_files(beatmapset_files_t* files, beatmap_t* beatmap, bool is_metadata_only, load_progress_t* progress) {
+    assert(files != NULL);
     assert(beatmap != NULL);
-    assert(difficulty != NULL);
+
+    parse_queue_t queue = {
+        .jobs   = calloc(kv_size(*files), sizeof(parse_job_t)),
+        .order  = malloc(kv_size(*files) * sizeof(parse_job_t*)),
+        .count  = kv_size(*files),
+        .archive = beatmap->archive,
+        .region = beatmap->region,
+        .is_metadata_only = is_metadata_only,
+        .progress = progress,
+    };
+    atomic_init(&queue.next, 0);
+    if (queue.count > 0 && (queue.jobs == NULL || queue.order == NULL)) {
+        free(queue.order);
+        free(queue.jobs);
+        LOG("out of memory while queueing the difficulties");
+        return ERROR_UNDEFINED;
+    }
+
+    // Dispatching the largest files first keeps the total time close to the time of the largest one
+    for (int i = 0; i < queue.count; i++) {
+        queue.jobs[i].file = &kv_A(*files, i);
+        queue.order[i] = &queue.jobs[i];
+    }
+    qsort(queue.order, queue.count, sizeof(parse_job_t*), compare_jobs_by_size);
+
+    pthread_t workers[MAX_PARSE_WORKERS];
+    int worker_count = 0;
+    for (int i = 1; i < get_worker_count(queue.count); i++) {
+        if (pthread_create(&workers[worker_count], NULL, parse_worker, &queue) != 0)
+            break;
+        worker_count++;
+    }
+
+    parse_worker(&queue);
+    for (int i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+
+    // Merge in file order so the result does not depend on thread scheduling
+    error_t err = ERROR_SUCCESS;
+    for (int i = 0; i < queue.count && err == ERROR_SUCCESS; i++) {
+        parse_job_t* job = &queue.jobs[i];
+        if (!job->is_parsed)
+            continue;
+
+        if (beatmap->title[0] == '\0')
+            STRCP(beatmap->title, job->beatmap.title);
+        if (job->beatmap.id)
+            beatmap->id = job->beatmap.id;
+
+        if (!region_kv_push(difficulty_t, beatmap->region, beatmap->difficulties, job->difficulty)) {
+            LOG("out of memory while merging the difficulties");
+            err = ERROR_UNDEFINED;
+        }
+    }
+
+    free(queue.order);
+    free(queue.jobs);
+    return err;
+}
+
+void* parse_worker(void* user) {
+    assert(user != NULL);
+
+    parse_queue_t* queue = (parse_queue_t*)user;
+
+    int i;
+    while ((i = atomic_fetch_add(&queue->next, 1)) < queue->count) {
+        parse_job_t* job = queue->order[i];
+        file_t* file = job->file;
+
+        if (is_cancelled(queue->progress))
+            break;
+
+        // Hashing would read the whole file, so the cache is only used for the bodies
+        bool is_cached = !queue->is_metadata_only && cache_is_enabled();
+        uint64_t hash = 0;
+        size_t size = file->size;
+        if (is_cached && hash_source(queue->archive, file->path, &hash, &size) != ERROR_SUCCESS) {
+            LOGF("Could not read \"%s\"", file->name);
+            finish_job(queue, job);
+            continue;
+        }
+
+        // Unchanged files are loaded from the cache, including the ones that failed to parse before
+        bool is_rejected = false;
+        job->difficulty.region = queue->region;
+        if (is_cached && cache_load(hash, size, &job->beatmap, &job->difficulty, &is_rejected) == ERROR_SUCCESS) {
+            STRCP(job->difficulty.file_name, file->name);
+            STRCP(job->difficulty.path, file->path);
+            job->difficulty.source_size = size;
+            job->difficulty.is_body_loaded = true;
+            job->is_parsed = !is_rejected;
+            if (!is_rejected)
+                difficulty_build_hitobject_arrays(&job->difficulty);
+            finish_job(queue, job);
+            continue;
+        }
+
+        chunk_reader_t reader;
+        if (open_source(&reader, queue->archive, file->path, 0) != ERROR_SUCCESS) {
+            LOGF("Could not read \"%s\"", file->name);
+            finish_job(queue, job);
+            continue;
+        }
+        job->is_parsed = parse_difficulty(file, &reader, size, queue->region, job, queue->progress, queue->is_metadata_only);
+        chunk_reader_close(&reader);
+
+        // A cancelled parse says nothing about the file
+        if (is_cached && !is_cancelled(queue->progress) && !job->is_out_of_memory)
+            cache_store(hash, size, &job->beatmap, &job->difficulty, !job->is_parsed);
+        if (!job->is_parsed) {
+            region_kv_destroy(queue->region, job->difficulty.timing_points);
+            region_kv_destroy(queue->region, job->difficulty.hitobjects);
+        }
+        finish_job(queue, job);
+    }
+
+    return NULL;
+}
+
+void finish_job(parse_queue_t* queue, parse_job_t* job) {
+    // Whatever parse_sections() did not report yet, also the unread body in metadata mode
+    if (job->file->size > job->bytes_reported)
+        atomic_fetch_add(&queue->progress->bytes_read, job->file->size - job->bytes_reported);
+    atomic_fetch_add(&queue->progress->difficulties_parsed, 1);
+}
+
+int get_worker_count(int job_count) {
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1)
+        cpu_count = 1;
+
+    int limit = atomic_load(&worker_limit);
+    long count = (limit > 0) ? (limit) : (cpu_count);
+    return MIN(MIN(job_count, count), MAX_PARSE_WORKERS);
+}
+
+bool parse_difficulty(file_t* file, chunk_reader_t* reader, size_t size, region_t* region, parse_job_t* job, load_progress_t* progress, bool is_metadata_only) {
+    assert(file != NULL);
+    assert(reader != NULL);
+    assert(job != NULL);
+
+    beatmap_t* beatmap = &job->beatmap;
+    difficulty_t* difficulty = &job->difficulty;
 
     memset(difficulty, 0, sizeof(difficulty_t));
     STRCP(difficulty->file_name, file->name);
-
-    ini_callback_args_t args = { beatmap, difficulty };
-    int err = ini_parse_string(file->data, ini_callback, &args);
-    if (err > 0) {
+    STRCP(difficulty->path, file->path);
+    difficulty->source_size = size;
+    difficulty->body_offset = size;
+    difficulty->region = region;
+
+    parse_context_t ctx = { beatmap, difficulty, .progress = progress };
+    bool is_parsed = parse_sections(&ctx, reader, is_metadata_only);
+    job->bytes_reported = ctx.bytes_reported;
+    job->is_out_of_memory = ctx.is_out_of_memory;
+    if (!is_parsed)
         return false;
+
+    if (is_metadata_only) {
+        LOGF("parsed metadata of \"%s\"", difficulty->file_name);
+        return true;
     }
-    else if (err < 0) {
-        LOGF("failed to parse \"%s\": file IO error", difficulty->file_name);
+
+    if (!sort_difficulty(difficulty)) {
+        job->is_out_of_memory = true;
         return false;
     }
-
-    ks_introsort(hitobject_t, kv_size(difficulty->hitobjects), difficulty->hitobjects.a);
-    ks_introsort(timing_point_t, kv_size(difficulty->timing_points), difficulty->timing_points.a);
+    difficulty_build_hitobject_arrays(difficulty);
+    difficulty->is_body_loaded = true;
 
     LOGF("parsed \"%s\"", difficulty->file_name);
     return true;
 }
 
-int ini_callback(void* user, const char* section, const char* line, int lineno) {
-    assert(user != NULL);
-    assert(section != NULL);
-    assert(line != NULL);
+bool parse_sections(parse_context_t* ctx, chunk_reader_t* reader, bool is_metadata_only) {
+    assert(ctx != NULL);
+    assert(reader != NULL);
+
+    osu_section_t section = SECTION_NULL;
+    size_t line_begin = chunk_reader_tell(reader);
+    int lineno = reader->lexer.lineno;
+    int line_count = 0;
+
+    span_t line;
+    while (chunk_reader_next_line(reader, &line)) {
+        if (line.data[0] == '[') {
+            if (line.data[line.size - 1] != ']') {
+                LOGF("failed to parse \"%s\": invalid section header at line %d", ctx->difficulty->file_name, reader->lexer.lineno);
+                return false;
+            }
+            section = osu_find_section((span_t){ line.data + 1, line.size - 2 });
+
+            // Everything from here on is only needed for gameplay
+            if (is_metadata_only && (section == SECTION_TIMING_POINTS || section == SECTION_HITOBJECTS)) {
+                ctx->difficulty->body_offset = line_begin;
+                ctx->difficulty->body_lineno = lineno;
+                return true;
+            }
+        }
+        else if (!parse_line(ctx, section, line, reader->lexer.lineno)) {
+            return false;
+        }
+
+        line_begin = chunk_reader_tell(reader);
+        lineno = reader->lexer.lineno;
+
+        if (ctx->progress && ++line_count % PROGRESS_INTERVAL == 0) {
+            atomic_fetch_add(&ctx->progress->bytes_read, line_begin - ctx->bytes_reported);
+            ctx->bytes_reported = line_begin;
+            if (is_cancelled(ctx->progress))
+                return false;
+        }
+    }
+
+    if (reader->is_failed) {
+        LOGF("failed to parse \"%s\": read error after line %d", ctx->difficulty->file_name, reader->lexer.lineno);
+        return false;
+    }
+
+    return true;
+}
+
+bool sort_difficulty(difficulty_t* difficulty) {
+    // Ranked maps are written in time order, so this is usually a single scan. Chords
+    // and timing points that share a time keep their file order.
+    if (!adaptive_sort_hitobjects(difficulty->hitobjects.a, kv_size(difficulty->hitobjects))
+        || !adaptive_sort_timing_points(difficulty->timing_points.a, kv_size(difficulty->timing_points))) {
+        // Everything after the parse looks things up by time, a partly sorted difficulty is unusable
+        LOGF("out of memory while sorting \"%s\"", difficulty->file_name);
+        return false;
+    }
+    return true;
+}
 
-    ini_callback_args_t* args = (ini_callback_args_t*)user;
+bool parse_line(parse_context_t* ctx, osu_section_t section, span_t line, int lineno) {
+    assert(ctx != NULL);
 
-    char key[64]        = {0};
     char value[256]     = {0};
-    char** params       = NULL;
+    span_t value_span   = {0};
+    span_t params[MAX_LINE_PARAMS];
     int params_count    = 0;
-    // int event_type      = 0;
 
-    khint_t key_hash;
-    khint_t section_hash = (section) ? kh_str_hash_func(section) : 0;
+    osu_key_t key = KEY_UNKNOWN;
 
-    if (section_hash == SECTION_GENERAL || section_hash == SECTION_METADATA || section_hash == SECTION_DIFFICULTY) {
-        int delim_i = TextFindIndex(line, ":");
-        memcpy(key, line, MIN(delim_i, ARRAY_LENGTH(key)));
-        memcpy(value, skip_space(line + delim_i + 1), MIN(strlen(skip_space(line + delim_i + 1)), ARRAY_LENGTH(value)));
-        key_hash = kh_str_hash_func(key);
+    if (section == SECTION_GENERAL || section == SECTION_METADATA || section == SECTION_DIFFICULTY) {
+        const char* delim = lexer_find(line.data, line.data + line.size, ':');
+        if (delim == line.data + line.size)
+            return true;
+
+        key = osu_find_key(span_trim((span_t){ line.data, delim - line.data }));
+        value_span = span_trim((span_t){ delim + 1, line.data + line.size - delim - 1 });
+        span_copy(value, ARRAY_LENGTH(value), value_span);
     }
-    else {
-        params_count = 0;
-        params = (char**)TextSplit(line, ',', &params_count);
-        // event_type = params[0][0] - '0';
+    else if (section == SECTION_TIMING_POINTS || section == SECTION_HITOBJECTS) {
+        params_count = lexer_split(line, ',', params, MAX_LINE_PARAMS);
     }
 
-    switch (section_hash) {
+    switch (section) {
     case SECTION_GENERAL:
-        switch (key_hash) {
+        switch (key) {
         case KEY_AUDIO_FILENAME:
-            STRCP(args->difficulty->audio_filename, value);
+            STRCP(ctx->difficulty->audio_filename, value);
             break;
 
         case KEY_MODE:
-            if (atoi(value) != 3) {
-                LOGF("failed to parse \"%s\": not an osu!mania beatmap (%s)", args->difficulty->file_name, line);
+            if (span_to_int(value_span) != 3) {
+                LOGF("failed to parse \"%s\": not an osu!mania beatmap (%.*s)", ctx->difficulty->file_name, (int)line.size, line.data);
                 return false;
             }
             break;
+
+        case KEY_PREVIEW_TIME:
+            ctx->difficulty->preview_time = span_to_int(value_span);
+            break;
+
+        default:
+            break;
         }
         break;
 
     case SECTION_METADATA:
-        switch (key_hash) {
+        switch (key) {
         case KEY_TITLE:
-            if (args->beatmap->title[0] == '\0')
-                STRCP(args->beatmap->title, value);
+            if (ctx->beatmap->title[0] == '\0')
+                STRCP(ctx->beatmap->title, value);
             break;
 
         case KEY_VERSION:
-            STRCP(args->difficulty->name, value);
+            STRCP(ctx->difficulty->name, value);
             break;
 
         case KEY_BEATMAP_ID:
-            args->difficulty->id = atoi(value);
+            ctx->difficulty->id = span_to_int(value_span);
             break;
 
         case KEY_BEATMAPSET_ID:
-            args->beatmap->id = atoi(value);
+            ctx->beatmap->id = span_to_int(value_span);
+            break;
+
+        default:
             break;
         }
         break;
 
     case SECTION_DIFFICULTY:
-        switch (key_hash) {
+        switch (key) {
         case KEY_CS:
-            args->difficulty->CS = atof(value);
+            ctx->difficulty->CS = span_to_double(value_span);
             break;
 
         case KEY_SV:
-            args->difficulty->SV = atof(value);
+            ctx->difficulty->SV = span_to_double(value_span);
+            break;
+
+        case KEY_HP:
+            ctx->difficulty->HP = span_to_double(value_span);
+            break;
+
+        case KEY_OD:
+            ctx->difficulty->OD = span_to_double(value_span);
+            break;
+
+        default:
             break;
         }
         break;
 
     case SECTION_TIMING_POINTS:
         if (params_count != 8) {
-            LOGF("failed to parse \"%s\": invalid timing point (\"%s\" at line %d)", args->difficulty->file_name, line, lineno);
+            LOGF("failed to parse \"%s\": invalid timing point (\"%.*s\" at line %d)", ctx->difficulty->file_name, (int)line.size, line.data, lineno);
             return false;
         }
 
-        seconds_t       start_time      = atoi(params[0]) / 1000.0f;
-        seconds_t       beat_length     = atof(params[1]);
-        // int             meter           = atoi(params[2]);
-        // int             sample_set      = atoi(params[3]);
-        // int             sample_index    = atoi(params[4]);
-        // percentage_t    volume          = atoi(params[5]) / 100.0f;
-        bool            is_uninherited  = atoi(params[6]) == 1;
-        // bool            effects         = atoi(params[7]);
-        bool            is_first_tm     = kv_size(args->difficulty->timing_points) == 0;
+        ms_t            start_time      = span_to_int(params[0]);
+        float           beat_length     = span_to_double(params[1]);
+        // int             meter           = span_to_int(params[2]);
+        // int             sample_set      = span_to_int(params[3]);
+        // int             sample_index    = span_to_int(params[4]);
+        // percentage_t    volume          = span_to_int(params[5]) / 100.0f;
+        bool            is_uninherited  = span_to_int(params[6]) == 1;
+        // bool            effects         = span_to_int(params[7]);
+        bool            is_first_tm     = kv_size(ctx->difficulty->timing_points) == 0;
 
         if (is_first_tm && !is_uninherited) {
-            LOGF("failed to parse \"%s\": first timing point can not be inhereited (\"%s\" at line %d)", args->difficulty->file_name, line, lineno);
+            LOGF("failed to parse \"%s\": first timing point can not be inhereited (\"%.*s\" at line %d)", ctx->difficulty->file_name, (int)line.size, line.data, lineno);
             return false;
         }
 
         timing_point_t prev_tm = (!is_first_tm)
-            ? (kv_A(args->difficulty->timing_points, kv_size(args->difficulty->timing_points) - 1))
+            ? (kv_A(ctx->difficulty->timing_points, kv_size(ctx->difficulty->timing_points) - 1))
             : ((timing_point_t){0});
 
         float BPM = (is_uninherited) ? (roundf(60000 / beat_length)) : (prev_tm.BPM);
-        float SV = (is_uninherited) ? (args->difficulty->SV) : (args->difficulty->SV * (100.0f / (float)(-beat_length)));
+        float SV = (is_uninherited) ? (ctx->difficulty->SV) : (ctx->difficulty->SV * (100.0f / (float)(-beat_length)));
 
         timing_point_t tm = (timing_point_t) {
             .time           = start_time,
             .BPM            = BPM,
             .SV             = SV,
-            // .y              = (is_first_tm) ? (0) : (prev_tm.y + (100 * prev_tm.SV) * (start_time - prev_tm.time) / (60.0f / prev_tm.BPM))
-        };  // FIXME:                           \_  this is probably untrue because tm.time of the first timing point might be negative.
-            //                                      It means that it should probably be calculated with parameters of the current timing point.
-        kv_push(timing_point_t, args->difficulty->timing_points, tm);
+        };  // scroll positions are integrated by playfield_create_from()
+        if (!region_kv_push(timing_point_t, ctx->difficulty->region, ctx->difficulty->timing_points, tm)) {
+            LOGF("out of memory while parsing \"%s\"", ctx->difficulty->file_name);
+            ctx->is_out_of_memory = true;
+            return false;
+        }
         break;
 
     case SECTION_HITOBJECTS:
         if (params_count < 5) {
-            LOGF("failed to parse \"%s\": invalid hit object (\"%s\" at line %d)", args->difficulty->file_name, line, lineno);
+            LOGF("failed to parse \"%s\": invalid hit object (\"%.*s\" at line %d)", ctx->difficulty->file_name, (int)line.size, line.data, lineno);
             return false;
         }
 
-        // int         x           = atoi(params[0]);
-        // int         y           = atoi(params[1]);
-        seconds_t   time_strt   = atoi(params[2]) / 1000.0f; // FIXME: WTFFF
-        int         type        = atoi(params[3]);
-        // int         hitsound    = atoi(params[4]);
+        // int         x           = span_to_int(params[0]);
+        // int         y           = span_to_int(params[1]);
+        ms_t        time_strt   = span_to_int(params[2]);
+        int         type        = span_to_int(params[3]);
+        // int         hitsound    = span_to_int(params[4]);
         bool        is_hold     = type == 128;
         int         column      = Clamp(
-            floorf(atoi(params[0]) * args->difficulty->CS / 512.0f),
+            floorf(span_to_int(params[0]) * ctx->difficulty->CS / 512.0f),
             0,
-            args->difficulty->CS - 1
+            ctx->difficulty->CS - 1
         );
 
-        if (is_hold)
-            strchr(params[5], ':')[0] = '\0';
+        // endTime of a hold note is the first value of the "endTime:hitSample" field,
+        // span_to_int() stops at the ':'
+        if (is_hold && params_count < 6) {
+            LOGF("failed to parse \"%s\": hold note without end time (\"%.*s\" at line %d)", ctx->difficulty->file_name, (int)line.size, line.data, lineno);
+            return false;
+        }
 
-        int i = difficulty_get_timing_point_index_for_time(args->difficulty, time_strt);
+        int i = difficulty_seek_timing_point(ctx->difficulty, &ctx->tm_cursor, time_strt);
         if (i < 0) {
             LOGF(
                 "failed to parse \"%s\":"
                 " hit object %ld does not have associated timing point"
-                " (\"%s\" at line %d)",
-                args->difficulty->file_name,
-                kv_size(args->difficulty->hitobjects) - 1,
-                line,
+                " (\"%.*s\" at line %d)",
+                ctx->difficulty->file_name,
+                kv_size(ctx->difficulty->hitobjects) - 1,
+                (int)line.size,
+                line.data,
                 lineno
             );
             return false;
         }
-        // timing_point_t* atm = &kv_A(args->difficulty->timing_points, i);
 
         hitobject_t ho = (hitobject_t) {
             .column     = column,
             .start_time = time_strt,
-            // .start_y    = atm->y + (100 * atm->SV) * (time_strt - atm->time) / (60.0f / atm->BPM),
-            .end_time   = (is_hold) ? atoi(params[5]) / 1000.0f : 0,
-            // .end_y      = 0
+            .end_time   = (is_hold) ? span_to_int(params[5]) : 0,
         };
 
-        kv_push(hitobject_t, args->difficulty->hitobjects, ho);
+        if (!region_kv_push(hitobject_t, ctx->difficulty->region, ctx->difficulty->hitobjects, ho)) {
+            LOGF("out of memory while parsing \"%s\"", ctx->difficulty->file_name);
+            ctx->is_out_of_memory = true;
+            return false;
+        }
         break;
 
-    case SECTION_NULL:
+    default:
         break;
     }
 
     return true;
 }
 
-const char* skip_space(const char* s) {
-    assert(s != NULL);
+int find_timing_point(const timing_point_t* tms, int count, ms_t time) {
+    // Index of the first timing point after `time`, minus one
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (tms[mid].time <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+size_t align_up(size_t size) {
+    return (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+uint32_t hitobject_key(const hitobject_t* ho) {
+    return adaptive_sort_int_key(ho->start_time);
+}
 
-    while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') s++;
-    return s;
+uint32_t timing_point_key(const timing_point_t* tm) {
+    return adaptive_sort_int_key(tm->time);
 }
 
-bool sort_hitobjects(hitobject_t a, hitobject_t b) {
-    return a.start_time < b.start_time;
+int compare_files_by_name(const void* a, const void* b) {
+    // Files in different subfolders can have the same name
+    int result = strcmp(((const file_t*)a)->name, ((const file_t*)b)->name);
+    return (result != 0) ? (result) : (strcmp(((const file_t*)a)->path, ((const file_t*)b)->path));
 }
 
-bool sort_timing_points(timing_point_t a, timing_point_t b) {
-    return a.time < b.time;
+int compare_jobs_by_size(const void* a, const void* b) {
+    size_t sa = (*(parse_job_t* const*)a)->file->size;
+    size_t sb = (*(parse_job_t* const*)b)->file->size;
+    return (sa < sb) - (sa > sb);
 }
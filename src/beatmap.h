@@ -5,58 +5,137 @@
 #ifndef BEATMAP_H
 #define BEATMAP_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include <kvec.h>
 #include <raylib.h>
 
 #include "util.h"
+#include "osz.h"
+#include "region.h"
 
 
 /* types */
+typedef int32_t ms_t;  // exact .osu timestamps, converted to seconds only for rendering and audio
 typedef float seconds_t;
 typedef float percentage_t;  // 1.0 is 100%
 
 typedef struct {
-    seconds_t               time;
+    ms_t                    time;
     float                   BPM;
     float                   SV;
 } timing_point_t;
 
 typedef struct {
-    seconds_t   start_time;
-    seconds_t   end_time;  // nonzero for hold note
+    ms_t        start_time;
+    ms_t        end_time;  // nonzero for hold note
     int         column;
 } hitobject_t;
 
+// The hit objects again, one array per field, for scans that only read one of
+// them. Same order and count as `hitobjects`, each array starts on a cache line.
+// `by_column` lists the indices of column k's objects, in time order, at
+// by_column[column_offsets[k]] up to by_column[column_offsets[k + 1]].
+typedef struct {
+    size_t      count;
+    ms_t*       start;
+    ms_t*       end;  // nonzero for hold note
+    uint8_t*    column;
+
+    int         column_count;  // at least CS
+    uint32_t*   column_offsets;  // column_count + 1 entries
+    uint32_t*   by_column;
+
+    void*       memory;  // one allocation from the difficulty's region backs all arrays
+} hitobject_arrays_t;
+
 typedef struct {
     id_t id;
     char name[256];
     char file_name[256];
+    char path[512];  // full path of the .osu, or its entry name when loaded from .osz
     char audio_filename[256];
+    ms_t preview_time;
 
+    float HP;
     float CS;  // column count in osu!mania
+    float OD;
     float SV;
 
     kvec_t(timing_point_t)  timing_points;
     kvec_t(hitobject_t)     hitobjects;
+    hitobject_arrays_t      hitobject_arrays;  // kept in sync by the loader, empty if out of memory
+
+    region_t* region;  // the beatmap's, shared with playfields created from this difficulty
+
+    // Set by beatmap_load_metadata(), timing points and hit objects stay empty until difficulty_load_body()
+    bool    is_body_loaded;
+    size_t  source_size;
+    size_t  body_offset;  // end of the last line before the first [TimingPoints] or [HitObjects] header
+    int     body_lineno;
 } difficulty_t;
 
+// Remembers the last timing point found so sweeps in time order only step forward
+typedef struct {
+    int index;  // -1 while before the first timing point, zero-initialize to start
+} timing_point_cursor_t;
+
 typedef struct {
     id_t id;
     char title[256];
 
     kvec_t(difficulty_t) difficulties;
+    region_t* region;  // owns the difficulties, their timing points and hit objects
+    osz_t* archive;  // audio and images of a beatmap loaded from .osz, NULL for folders
 } beatmap_t;
 
+typedef enum {
+    BEATMAP_LOAD_RUNNING,
+    BEATMAP_LOAD_DONE,
+    BEATMAP_LOAD_FAILED,
+    BEATMAP_LOAD_CANCELLED,
+} beatmap_load_state_t;
+
+typedef struct {
+    size_t  bytes_read;
+    size_t  bytes_total;  // known once the files are listed
+    int     difficulties_parsed;  // including the ones that failed to parse
+    int     difficulty_count;
+} beatmap_load_progress_t;
+
+// Background beatmap_load(), see beatmap_load_async()
+typedef struct beatmap_load_task_t beatmap_load_task_t;
+
 
 /* function declarations */
 error_t beatmap_load(beatmap_t* beatmap, const char* path);
+error_t beatmap_load_metadata(beatmap_t* beatmap, const char* path);  // only parses sections before the timing points
 void    beatmap_destroy(beatmap_t* beatmap);
 void    beatmap_debug_print(beatmap_t* beatmap);
-
-timing_point_t* difficulty_get_timing_point_for_time(difficulty_t* difficulty, seconds_t time);
-int             difficulty_get_timing_point_index_for_time(difficulty_t* difficulty, seconds_t time);
+// Threads that parse the difficulties of one load, including the loading thread.
+// 0, the default, is one per CPU. At most 16 are used.
+void    beatmap_set_worker_count(int count);
+
+// Loads on a background thread so the caller can keep rendering. Poll the task
+// each frame and call beatmap_load_task_finish() exactly once, also after
+// cancelling, to get the beatmap and free the task.
+beatmap_load_task_t*    beatmap_load_async(const char* path, bool is_metadata_only);  // NULL if the thread could not start
+beatmap_load_state_t    beatmap_load_task_poll(beatmap_load_task_t* task, beatmap_load_progress_t* progress);  // `progress` may be NULL
+void                    beatmap_load_task_cancel(beatmap_load_task_t* task);  // returns immediately, the load stops soon after
+error_t                 beatmap_load_task_finish(beatmap_load_task_t* task, beatmap_t* beatmap);  // waits for the task
+
+error_t         difficulty_load_body(beatmap_t* beatmap, difficulty_t* difficulty);
+// Return the last timing point at or before `time`, or NULL/-1 if there is none
+timing_point_t* difficulty_get_timing_point_for_time(difficulty_t* difficulty, ms_t time);
+int             difficulty_get_timing_point_index_for_time(difficulty_t* difficulty, ms_t time);
+int             difficulty_seek_timing_point(difficulty_t* difficulty, timing_point_cursor_t* cursor, ms_t time);
+// Rebuilds `hitobject_arrays` from `hitobjects`, call it after changing them by hand
+error_t         difficulty_build_hitobject_arrays(difficulty_t* difficulty);
+
+seconds_t       ms_to_seconds(ms_t ms);
+ms_t            seconds_to_ms(seconds_t seconds);  // rounds to the nearest millisecond
 
 
 #endif
@@ -0,0 +1,316 @@
+#define SCOPE_NAME "beatmap cache"
+#include "cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#if defined(_WIN32)
+    #include <direct.h>
+    #define make_directory(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #define make_directory(path) mkdir(path, 0755)
+#endif
+
+#include <kvec.h>
+
+#include "util.h"
+#include "beatmap.h"
+#include "mapped_file.h"
+
+
+/* constants */
+#define CMB_MAGIC               "CMB"
+#define CMB_VERSION             4  // bump whenever the parser produces different results
+#define CMB_ALIGNMENT           64
+#define CMB_FLAG_REJECTED       0x1  // the .osu could not be parsed, don't retry it
+#define CMB_HASH_SEED           0xcbf29ce484222325ull
+#define MAX_PATH_LENGTH         1024
+#define HASH_CHUNK_SIZE         16384
+
+
+/* types */
+// Everything is stored in native byte order and layout, the struct sizes in the
+// header invalidate the cache if timing_point_t or hitobject_t ever change.
+typedef struct {
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    source_hash;
+    uint64_t    source_size;
+    uint32_t    flags;
+    uint32_t    timing_point_size;
+    uint32_t    hitobject_size;
+    uint32_t    timing_point_count;
+    uint32_t    hitobject_count;
+    uint32_t    beatmapset_id;
+    uint64_t    timing_points_offset;
+    uint64_t    hitobjects_offset;
+
+    char        title[256];
+    uint32_t    id;
+    char        name[256];
+    char        audio_filename[256];
+    int32_t     preview_time;
+    float       HP;
+    float       CS;
+    float       OD;
+    float       SV;
+} cmb_header_t;
+
+
+static atomic_bool is_cache_enabled = true;
+
+
+/* local functions */
+static bool     get_cache_path(char* path, size_t size, uint64_t hash, const char* suffix);
+static size_t   align_offset(size_t offset);
+static bool     write_padded(FILE* file, const void* data, size_t size, size_t* offset);
+static void     copy_string(char* dest, const char* src, size_t size);
+
+
+uint64_t cache_hash(const void* data, size_t size) {
+    return cache_hash_update(CMB_HASH_SEED, data, size);
+}
+
+uint64_t cache_hash_update(uint64_t hash, const void* data, size_t size) {
+    // FNV-1a
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+error_t cache_hash_file(const char* path, uint64_t* hash, size_t* size) {
+    assert(path != NULL);
+    assert(hash != NULL);
+    assert(size != NULL);
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return ERROR_FILE_NOT_FOUND;
+
+    char buffer[HASH_CHUNK_SIZE];
+    size_t read;
+    *hash = CMB_HASH_SEED;
+    *size = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        *hash = cache_hash_update(*hash, buffer, read);
+        *size += read;
+    }
+
+    bool is_failed = ferror(file) != 0;
+    fclose(file);
+    return (is_failed) ? (ERROR_UNDEFINED) : (ERROR_SUCCESS);
+}
+
+error_t cache_load(uint64_t hash, size_t source_size, beatmap_t* beatmap, difficulty_t* difficulty, bool* is_rejected) {
+    assert(beatmap != NULL);
+    assert(difficulty != NULL);
+    assert(is_rejected != NULL);
+
+    char path[MAX_PATH_LENGTH];
+    if (!get_cache_path(path, sizeof(path), hash, ".cmb"))
+        return ERROR_FILE_NOT_FOUND;
+
+    mapped_file_t file;
+    CHECK_ERROR_PROPAGATE(mapped_file_load(&file, path));
+
+    const cmb_header_t* header = (const cmb_header_t*)file.data;
+    size_t tm_bytes = (file.size >= sizeof(cmb_header_t)) ? ((size_t)header->timing_point_count * sizeof(timing_point_t)) : (0);
+    size_t ho_bytes = (file.size >= sizeof(cmb_header_t)) ? ((size_t)header->hitobject_count * sizeof(hitobject_t)) : (0);
+
+    bool is_valid = file.size >= sizeof(cmb_header_t)
+        && memcmp(header->magic, CMB_MAGIC, sizeof(header->magic)) == 0
+        && header->version == CMB_VERSION
+        && header->source_hash == hash
+        && header->source_size == source_size
+        && header->timing_point_size == sizeof(timing_point_t)
+        && header->hitobject_size == sizeof(hitobject_t)
+        && header->timing_points_offset % CMB_ALIGNMENT == 0
+        && header->hitobjects_offset % CMB_ALIGNMENT == 0
+        && header->timing_points_offset <= file.size && tm_bytes <= file.size - header->timing_points_offset
+        && header->hitobjects_offset <= file.size && ho_bytes <= file.size - header->hitobjects_offset;
+    if (!is_valid) {
+        mapped_file_unload(&file);
+        return ERROR_INVALID_FORMAT;
+    }
+
+    *is_rejected = header->flags & CMB_FLAG_REJECTED;
+
+    // Copied out instead of pointing into the mapping, the vectors must stay writable
+    kv_init(difficulty->timing_points);
+    kv_init(difficulty->hitobjects);
+    if (tm_bytes)
+        region_kv_resize(timing_point_t, difficulty->region, difficulty->timing_points, header->timing_point_count);
+    if (ho_bytes)
+        region_kv_resize(hitobject_t, difficulty->region, difficulty->hitobjects, header->hitobject_count);
+    if ((tm_bytes && difficulty->timing_points.a == NULL) || (ho_bytes && difficulty->hitobjects.a == NULL)) {
+        region_kv_destroy(difficulty->region, difficulty->timing_points);
+        region_kv_destroy(difficulty->region, difficulty->hitobjects);
+        kv_init(difficulty->timing_points);
+        kv_init(difficulty->hitobjects);
+        mapped_file_unload(&file);
+        return ERROR_UNDEFINED;
+    }
+    if (tm_bytes)
+        memcpy(difficulty->timing_points.a, file.data + header->timing_points_offset, tm_bytes);
+    if (ho_bytes)
+        memcpy(difficulty->hitobjects.a, file.data + header->hitobjects_offset, ho_bytes);
+    kv_size(difficulty->timing_points) = header->timing_point_count;
+    kv_size(difficulty->hitobjects) = header->hitobject_count;
+
+    copy_string(beatmap->title, header->title, sizeof(beatmap->title));
+    beatmap->id = header->beatmapset_id;
+
+    difficulty->id = header->id;
+    copy_string(difficulty->name, header->name, sizeof(difficulty->name));
+    copy_string(difficulty->audio_filename, header->audio_filename, sizeof(difficulty->audio_filename));
+    difficulty->preview_time = header->preview_time;
+    difficulty->HP = header->HP;
+    difficulty->CS = header->CS;
+    difficulty->OD = header->OD;
+    difficulty->SV = header->SV;
+
+    mapped_file_unload(&file);
+    return ERROR_SUCCESS;
+}
+
+void cache_store(uint64_t hash, size_t source_size, const beatmap_t* beatmap, const difficulty_t* difficulty, bool is_rejected) {
+    assert(beatmap != NULL);
+    assert(difficulty != NULL);
+
+    char path[MAX_PATH_LENGTH];
+    char temp_path[MAX_PATH_LENGTH + 32];
+    if (!get_cache_path(path, sizeof(path), hash, ".cmb"))
+        return;
+
+    // Several workers may compile the same file, each writes its own temporary copy
+    snprintf(temp_path, sizeof(temp_path), "%s.%p.tmp", path, (const void*)difficulty);
+
+    size_t tm_bytes = kv_size(difficulty->timing_points) * sizeof(timing_point_t);
+    size_t ho_bytes = kv_size(difficulty->hitobjects) * sizeof(hitobject_t);
+
+    cmb_header_t header = {
+        .magic                  = CMB_MAGIC,
+        .version                = CMB_VERSION,
+        .source_hash            = hash,
+        .source_size            = source_size,
+        .flags                  = (is_rejected) ? (CMB_FLAG_REJECTED) : (0),
+        .timing_point_size      = sizeof(timing_point_t),
+        .hitobject_size         = sizeof(hitobject_t),
+        .timing_point_count     = (is_rejected) ? (0) : (kv_size(difficulty->timing_points)),
+        .hitobject_count        = (is_rejected) ? (0) : (kv_size(difficulty->hitobjects)),
+        .beatmapset_id          = beatmap->id,
+        .id                     = difficulty->id,
+        .preview_time           = difficulty->preview_time,
+        .HP                     = difficulty->HP,
+        .CS                     = difficulty->CS,
+        .OD                     = difficulty->OD,
+        .SV                     = difficulty->SV,
+    };
+    copy_string(header.title, beatmap->title, sizeof(header.title));
+    copy_string(header.name, difficulty->name, sizeof(header.name));
+    copy_string(header.audio_filename, difficulty->audio_filename, sizeof(header.audio_filename));
+
+    header.timing_points_offset = align_offset(sizeof(cmb_header_t));
+    header.hitobjects_offset = align_offset(header.timing_points_offset + ((is_rejected) ? (0) : (tm_bytes)));
+
+    FILE* file = fopen(temp_path, "wb");
+    if (file == NULL)
+        return;
+
+    size_t offset = 0;
+    bool is_written = write_padded(file, &header, sizeof(header), &offset);
+    if (!is_rejected) {
+        is_written = is_written && write_padded(file, difficulty->timing_points.a, tm_bytes, &offset);
+        is_written = is_written && write_padded(file, difficulty->hitobjects.a, ho_bytes, &offset);
+    }
+    is_written = (fclose(file) == 0) && is_written;
+
+    // Readers either see the complete file or none at all
+    if (!is_written || rename(temp_path, path) != 0)
+        remove(temp_path);
+}
+
+bool cache_is_enabled(void) {
+    const char* dir = getenv("CMANIA_CACHE_DIR");
+    return atomic_load(&is_cache_enabled) && (dir == NULL || dir[0] != '\0');
+}
+
+void cache_set_enabled(bool is_enabled) {
+    atomic_store(&is_cache_enabled, is_enabled);
+}
+
+bool get_cache_path(char* path, size_t size, uint64_t hash, const char* suffix) {
+    char directory[MAX_PATH_LENGTH];
+    if (!cache_is_enabled() || !cache_get_directory(directory, sizeof(directory)))
+        return false;
+
+    int length = snprintf(path, size, "%s/%016llx%s", directory, (unsigned long long)hash, suffix);
+    return length > 0 && (size_t)length < size;
+}
+
+bool cache_get_directory(char* path, size_t size) {
+    const char* dir = getenv("CMANIA_CACHE_DIR");
+    const char* xdg = getenv("XDG_CACHE_HOME");
+#if defined(_WIN32)
+    const char* home = getenv("LOCALAPPDATA");
+    const char* home_suffix = "";
+#else
+    const char* home = getenv("HOME");
+    const char* home_suffix = "/.cache";
+#endif
+
+    int length;
+    if (dir && dir[0]) {
+        length = snprintf(path, size, "%s", dir);
+    }
+    else if (xdg && xdg[0]) {
+        length = snprintf(path, size, "%s/cmania", xdg);
+    }
+    else if (home && home[0]) {
+        char parent[MAX_PATH_LENGTH];
+        snprintf(parent, sizeof(parent), "%s%s", home, home_suffix);
+        make_directory(parent);
+        length = snprintf(path, size, "%s/cmania", parent);
+    }
+    else {
+        return false;
+    }
+
+    if (length <= 0 || (size_t)length >= size)
+        return false;
+
+    return make_directory(path) == 0 || errno == EEXIST;
+}
+
+size_t align_offset(size_t offset) {
+    return (offset + CMB_ALIGNMENT - 1) / CMB_ALIGNMENT * CMB_ALIGNMENT;
+}
+
+bool write_padded(FILE* file, const void* data, size_t size, size_t* offset) {
+    static const char zeros[CMB_ALIGNMENT] = {0};
+
+    if (size && fwrite(data, 1, size, file) != size)
+        return false;
+    *offset += size;
+
+    size_t padding = align_offset(*offset) - *offset;
+    if (padding && fwrite(zeros, 1, padding, file) != padding)
+        return false;
+    *offset += padding;
+
+    return true;
+}
+
+void copy_string(char* dest, const char* src, size_t size) {
+    size_t length = strnlen(src, size - 1);
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+}
@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util.h"
+#include "beatmap.h"
+
+
+/* function declarations */
+// Compiled difficulties (.cmb) live in a cache directory and are named after the
+// hash of the .osu they were parsed from, so a hit is always fresh. The directory
+// is $CMANIA_CACHE_DIR, $XDG_CACHE_HOME/cmania or ~/.cache/cmania. An empty
+// $CMANIA_CACHE_DIR or cache_set_enabled(false) turns the .cmb files off, the
+// library index still uses the directory.
+bool        cache_get_directory(char* path, size_t size);  // creates it if needed
+bool        cache_is_enabled(void);
+void        cache_set_enabled(bool is_enabled);  // not while a beatmap is loading
+uint64_t    cache_hash(const void* data, size_t size);
+uint64_t    cache_hash_update(uint64_t hash, const void* data, size_t size);  // start with cache_hash(NULL, 0)
+error_t     cache_hash_file(const char* path, uint64_t* hash, size_t* size);  // reads through a fixed buffer
+
+// On success the timing points and hit objects are copied into `difficulty->region`,
+// so they are owned like parsed ones. `beatmap` only receives the set title and id.
+error_t     cache_load(uint64_t hash, size_t source_size, beatmap_t* beatmap, difficulty_t* difficulty, bool* is_rejected);
+void        cache_store(uint64_t hash, size_t source_size, const beatmap_t* beatmap, const difficulty_t* difficulty, bool is_rejected);
+
+
+#endif
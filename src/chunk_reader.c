@@ -0,0 +1,166 @@
+#define SCOPE_NAME "chunk reader"
+#include "chunk_reader.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "lexer.h"
+#include "osz.h"
+
+
+/* constants */
+#define CHUNK_SIZE 65536
+
+
+/* local functions */
+static error_t      init_buffer(chunk_reader_t* reader, size_t offset);
+static bool         refill(chunk_reader_t* reader);
+static size_t       read_more(chunk_reader_t* reader, char* out, size_t size, bool* is_failed);
+static const char*  find_last_newline(const char* begin, const char* end);
+
+
+error_t chunk_reader_open(chunk_reader_t* reader, const char* path, size_t offset) {
+    assert(reader != NULL);
+    assert(path != NULL);
+
+    memset(reader, 0, sizeof(chunk_reader_t));
+
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL)
+        return ERROR_FILE_NOT_FOUND;
+
+    if (offset && fseek(reader->file, (long)offset, SEEK_SET) != 0) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return ERROR_UNDEFINED;
+    }
+
+    error_t err = init_buffer(reader, offset);
+    if (err != ERROR_SUCCESS)
+        chunk_reader_close(reader);
+    return err;
+}
+
+error_t chunk_reader_open_entry(chunk_reader_t* reader, osz_t* archive, int index, size_t offset) {
+    assert(reader != NULL);
+    assert(archive != NULL);
+
+    memset(reader, 0, sizeof(chunk_reader_t));
+
+    CHECK_ERROR_PROPAGATE(osz_reader_open(&reader->entry, archive, index));
+    error_t err = init_buffer(reader, 0);
+
+    // Deflated data cannot be seeked, the part before `offset` goes through the window
+    while (err == ERROR_SUCCESS && reader->offset < offset) {
+        size_t read;
+        err = osz_reader_read(&reader->entry, reader->buffer, MIN(reader->capacity, offset - reader->offset), &read);
+        if (err == ERROR_SUCCESS && read == 0)
+            err = ERROR_INVALID_FORMAT;
+        reader->offset += read;
+    }
+
+    if (err != ERROR_SUCCESS)
+        chunk_reader_close(reader);
+    return err;
+}
+
+void chunk_reader_close(chunk_reader_t* reader) {
+    assert(reader != NULL);
+
+    if (reader->file)
+        fclose(reader->file);
+    if (reader->entry.entry)
+        osz_reader_close(&reader->entry);
+    free(reader->buffer);
+    memset(reader, 0, sizeof(chunk_reader_t));
+}
+
+bool chunk_reader_next_line(chunk_reader_t* reader, span_t* line) {
+    assert(reader != NULL);
+    assert(line != NULL);
+
+    while (!lexer_next_line(&reader->lexer, line))
+        if (!refill(reader))
+            return false;
+
+    return true;
+}
+
+size_t chunk_reader_tell(const chunk_reader_t* reader) {
+    assert(reader != NULL);
+
+    return reader->offset + (reader->lexer.cursor - reader->buffer);
+}
+
+error_t init_buffer(chunk_reader_t* reader, size_t offset) {
+    reader->buffer = malloc(CHUNK_SIZE);
+    if (reader->buffer == NULL)
+        return ERROR_UNDEFINED;
+
+    reader->capacity = CHUNK_SIZE;
+    reader->offset = offset;
+    lexer_init(&reader->lexer, reader->buffer, 0);
+    return ERROR_SUCCESS;
+}
+
+bool refill(chunk_reader_t* reader) {
+    if (reader->is_eof)
+        return false;
+
+    // Keep the incomplete line at the end of the window
+    size_t consumed = reader->lexer.end - reader->buffer;
+    size_t remaining = reader->size - consumed;
+    memmove(reader->buffer, reader->buffer + consumed, remaining);
+    reader->offset += consumed;
+    reader->size = remaining;
+
+    if (reader->size == reader->capacity) {
+        char* buffer = realloc(reader->buffer, reader->capacity * 2);
+        if (buffer == NULL) {
+            reader->is_eof = reader->is_failed = true;
+            return false;
+        }
+        reader->buffer = buffer;
+        reader->capacity *= 2;
+    }
+
+    size_t requested = reader->capacity - reader->size;
+    bool is_failed = false;
+    size_t read = read_more(reader, reader->buffer + reader->size, requested, &is_failed);
+    reader->size += read;
+    if (read < requested || is_failed) {
+        reader->is_eof = true;
+        reader->is_failed = is_failed;
+    }
+
+    const char* end = reader->buffer + reader->size;
+    if (!reader->is_eof)
+        end = find_last_newline(reader->buffer, end);
+
+    int lineno = reader->lexer.lineno;
+    lexer_init(&reader->lexer, reader->buffer, end - reader->buffer);
+    reader->lexer.lineno = lineno;
+    return true;
+}
+
+size_t read_more(chunk_reader_t* reader, char* out, size_t size, bool* is_failed) {
+    if (reader->file) {
+        size_t read = fread(out, 1, size, reader->file);
+        *is_failed = read < size && ferror(reader->file) != 0;
+        return read;
+    }
+
+    size_t read = 0;
+    *is_failed = osz_reader_read(&reader->entry, out, size, &read) != ERROR_SUCCESS;
+    return read;
+}
+
+const char* find_last_newline(const char* begin, const char* end) {
+    // Returns the position after it, or `begin` if there is none
+    for (const char* p = end; p > begin; p--)
+        if (p[-1] == '\n')
+            return p;
+    return begin;
+}
@@ -0,0 +1,39 @@
+#ifndef CHUNK_READER_H
+#define CHUNK_READER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util.h"
+#include "lexer.h"
+#include "osz.h"
+
+
+/* types */
+// Reads a text file or .osz entry line by line through a fixed-size window, so
+// memory use does not depend on the file size. The window only grows for a line
+// longer than itself. Lines are returned with the same rules as lexer_next_line().
+typedef struct {
+    FILE*           file;  // NULL when reading an entry
+    osz_reader_t    entry;
+    char*           buffer;
+    size_t          capacity;
+    size_t          size;
+    size_t          offset;  // file offset of the start of the window
+    bool            is_eof;
+    bool            is_failed;  // read error or corrupted entry, the lines returned so far are valid
+    lexer_t         lexer;  // only covers the complete lines of the window
+} chunk_reader_t;
+
+
+/* function declarations */
+error_t chunk_reader_open(chunk_reader_t* reader, const char* path, size_t offset);
+error_t chunk_reader_open_entry(chunk_reader_t* reader, osz_t* archive, int index, size_t offset);  // inflates what comes before `offset`
+void    chunk_reader_close(chunk_reader_t* reader);
+
+bool    chunk_reader_next_line(chunk_reader_t* reader, span_t* line);
+size_t  chunk_reader_tell(const chunk_reader_t* reader);  // offset of the first byte not returned yet
+
+
+#endif
@@ -0,0 +1,485 @@
+#include "inflate.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+
+/* constants */
+#define MAX_BITS        15
+#define MAX_LIT_CODES   288
+#define MAX_DIST_CODES  30
+#define FAST_BITS       9
+#define FAST_MASK       ((1 << FAST_BITS) - 1)
+#define WINDOW_SIZE     32768  // farthest a match can reach back
+
+
+/* types */
+typedef struct {
+    uint16_t count[MAX_BITS + 1];   // number of codes of each length
+    uint16_t symbol[MAX_LIT_CODES]; // symbols ordered by code
+    uint16_t fast[1 << FAST_BITS];  // (length << FAST_BITS) | symbol for short codes, 0 otherwise
+} huffman_t;
+
+typedef enum {
+    MODE_HEADER,
+    MODE_STORED,
+    MODE_CODES,
+    MODE_DONE,
+    MODE_FAILED,
+} inflate_mode_t;
+
+// Decoding stops whenever `out` is full and picks up where it left off once there
+// is room again. Matches reach back into `out`, so it has to keep the history.
+typedef struct {
+    const uint8_t*  in;
+    size_t          in_size;
+    size_t          in_pos;  // may run past in_size, reads beyond the end yield zero bits
+    uint64_t        bitbuf;
+    int             bitcnt;
+
+    uint8_t*        out;
+    size_t          out_size;
+    size_t          out_pos;
+
+    inflate_mode_t  mode;
+    bool            is_last;
+    size_t          stored_left;
+    int             literal;  // decoded before `out` filled up, -1 if none
+    size_t          match_left;
+    size_t          match_distance;
+    huffman_t       lit;
+    huffman_t       dist;
+} inflate_state_t;
+
+struct inflate_stream_t {
+    inflate_state_t state;  // `out` is `window`
+    size_t          read_pos;  // first byte of `window` not returned yet
+    uint8_t         window[2 * WINDOW_SIZE];  // history, then new output
+};
+
+
+/* local functions */
+static void         init_state(inflate_state_t* s, const void* in, size_t in_size, void* out, size_t out_size);
+static error_t      run(inflate_state_t* s);
+static error_t      read_header(inflate_state_t* s);
+static void         refill(inflate_state_t* s);
+static int          get_bits(inflate_state_t* s, int count);
+static bool         is_overrun(inflate_state_t* s);
+static bool         build_huffman(huffman_t* h, const uint8_t* lengths, int n);
+static int          decode(inflate_state_t* s, const huffman_t* h);
+static error_t      inflate_stored(inflate_state_t* s);
+static error_t      inflate_codes(inflate_state_t* s);
+static error_t      begin_stored(inflate_state_t* s);
+static void         begin_fixed(inflate_state_t* s);
+static error_t      begin_dynamic(inflate_state_t* s);
+static void         finish_block(inflate_state_t* s);
+
+
+error_t inflate_raw(const void* in, size_t in_size, void* out, size_t out_size, size_t* out_written) {
+    assert(in != NULL || in_size == 0);
+    assert(out != NULL || out_size == 0);
+
+    inflate_state_t s;
+    init_state(&s, in, in_size, out, out_size);
+    CHECK_ERROR_PROPAGATE(run(&s));
+    if (s.mode != MODE_DONE)
+        return ERROR_INVALID_FORMAT;  // `out` is too small
+
+    if (out_written)
+        *out_written = s.out_pos;
+    return ERROR_SUCCESS;
+}
+
+inflate_stream_t* inflate_stream_create(const void* in, size_t in_size) {
+    assert(in != NULL || in_size == 0);
+
+    inflate_stream_t* stream = malloc(sizeof(inflate_stream_t));
+    if (stream == NULL)
+        return NULL;
+
+    init_state(&stream->state, in, in_size, stream->window, sizeof(stream->window));
+    stream->read_pos = 0;
+    return stream;
+}
+
+void inflate_stream_destroy(inflate_stream_t* stream) {
+    free(stream);
+}
+
+error_t inflate_stream_read(inflate_stream_t* stream, void* out, size_t out_size, size_t* out_read) {
+    assert(stream != NULL);
+    assert(out != NULL || out_size == 0);
+    assert(out_read != NULL);
+
+    inflate_state_t* s = &stream->state;
+    *out_read = 0;
+
+    while (*out_read < out_size) {
+        if (stream->read_pos == s->out_pos) {
+            if (s->mode == MODE_DONE)
+                break;
+
+            // Only the last WINDOW_SIZE bytes can still be referenced
+            if (s->out_pos == s->out_size) {
+                memmove(stream->window, stream->window + s->out_pos - WINDOW_SIZE, WINDOW_SIZE);
+                s->out_pos = stream->read_pos = WINDOW_SIZE;
+            }
+            CHECK_ERROR_PROPAGATE(run(s));
+            continue;
+        }
+
+        size_t size = MIN(s->out_pos - stream->read_pos, out_size - *out_read);
+        memcpy((uint8_t*)out + *out_read, stream->window + stream->read_pos, size);
+        stream->read_pos += size;
+        *out_read += size;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ p[i]) & 0x0f] ^ (crc >> 4);
+        crc = table[(crc ^ (p[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+void init_state(inflate_state_t* s, const void* in, size_t in_size, void* out, size_t out_size) {
+    memset(s, 0, offsetof(inflate_state_t, lit));
+    s->in = (const uint8_t*)in;
+    s->in_size = in_size;
+    s->out = (uint8_t*)out;
+    s->out_size = out_size;
+    s->mode = MODE_HEADER;
+    s->literal = -1;
+}
+
+error_t run(inflate_state_t* s) {
+    // Returns once the stream ends or `out` is full
+    while (s->mode != MODE_DONE) {
+        inflate_mode_t mode = s->mode;
+
+        error_t err;
+        switch (mode) {
+        case MODE_HEADER:   err = read_header(s);        break;
+        case MODE_STORED:   err = inflate_stored(s);     break;
+        case MODE_CODES:    err = inflate_codes(s);      break;
+        default:            err = ERROR_INVALID_FORMAT;  break;
+        }
+
+        if (err != ERROR_SUCCESS || is_overrun(s)) {
+            s->mode = MODE_FAILED;
+            return ERROR_INVALID_FORMAT;
+        }
+        if (s->mode == mode && mode != MODE_HEADER)
+            break;  // no room left in `out`
+    }
+
+    return ERROR_SUCCESS;
+}
+
+error_t read_header(inflate_state_t* s) {
+    refill(s);
+    s->is_last = get_bits(s, 1);
+    int type = get_bits(s, 2);
+
+    switch (type) {
+    case 0:  return begin_stored(s);
+    case 1:  begin_fixed(s); return ERROR_SUCCESS;
+    case 2:  return begin_dynamic(s);
+    default: return ERROR_INVALID_FORMAT;
+    }
+}
+
+void refill(inflate_state_t* s) {
+    while (s->bitcnt <= 56) {
+        uint64_t byte = (s->in_pos < s->in_size) ? (s->in[s->in_pos]) : (0);
+        s->bitbuf |= byte << s->bitcnt;
+        s->bitcnt += 8;
+        s->in_pos++;
+    }
+}
+
+int get_bits(inflate_state_t* s, int count) {
+    assert(count <= 32);
+
+    if (s->bitcnt < count)
+        refill(s);
+
+    int value = (int)(s->bitbuf & ((1ull << count) - 1));
+    s->bitbuf >>= count;
+    s->bitcnt -= count;
+    return value;
+}
+
+bool is_overrun(inflate_state_t* s) {
+    return s->in_pos - (s->bitcnt >> 3) > s->in_size;
+}
+
+bool build_huffman(huffman_t* h, const uint8_t* lengths, int n) {
+    memset(h, 0, sizeof(huffman_t));
+
+    for (int i = 0; i < n; i++)
+        h->count[lengths[i]]++;
+    if (h->count[0] == n)
+        return true;  // no codes, any decode attempt fails
+
+    // Over-subscribed sets are invalid, incomplete ones are allowed (single distance code)
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+            return false;
+    }
+
+    uint16_t offsets[MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + h->count[len];
+    for (int i = 0; i < n; i++)
+        if (lengths[i])
+            h->symbol[offsets[lengths[i]]++] = i;
+
+    // Deflate codes are stored MSB first, so the lookup index is the bit-reversed code
+    int code = 0;
+    int index = 0;
+    for (int len = 1; len <= FAST_BITS; len++) {
+        for (int k = 0; k < h->count[len]; k++, code++) {
+            int reversed = 0;
+            for (int b = 0; b < len; b++)
+                reversed |= ((code >> b) & 1) << (len - 1 - b);
+
+            uint16_t entry = (len << FAST_BITS) | h->symbol[index++];
+            for (int j = reversed; j < (1 << FAST_BITS); j += 1 << len)
+                h->fast[j] = entry;
+        }
+        code <<= 1;
+    }
+
+    return true;
+}
+
+int decode(inflate_state_t* s, const huffman_t* h) {
+    if (s->bitcnt < MAX_BITS)
+        refill(s);
+
+    uint16_t entry = h->fast[s->bitbuf & FAST_MASK];
+    if (entry) {
+        int len = entry >> FAST_BITS;
+        s->bitbuf >>= len;
+        s->bitcnt -= len;
+        return entry & FAST_MASK;
+    }
+
+    // Canonical decoding of codes longer than FAST_BITS, one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code |= (s->bitbuf >> (len - 1)) & 1;
+        int count = h->count[len];
+        if (code - first < count) {
+            s->bitbuf >>= len;
+            s->bitcnt -= len;
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+error_t begin_stored(inflate_state_t* s) {
+    // Drop the partial byte and rewind to the first unread byte
+    s->in_pos -= s->bitcnt >> 3;
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    if (s->in_pos + 4 > s->in_size)
+        return ERROR_INVALID_FORMAT;
+
+    const uint8_t* p = s->in + s->in_pos;
+    size_t len = p[0] | (p[1] << 8);
+    size_t nlen = p[2] | (p[3] << 8);
+    s->in_pos += 4;
+
+    if (len != (~nlen & 0xffff))
+        return ERROR_INVALID_FORMAT;
+    if (len > s->in_size - s->in_pos)
+        return ERROR_INVALID_FORMAT;
+
+    s->stored_left = len;
+    s->mode = MODE_STORED;
+    return ERROR_SUCCESS;
+}
+
+error_t inflate_stored(inflate_state_t* s) {
+    size_t size = MIN(s->stored_left, s->out_size - s->out_pos);
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, size);
+    s->in_pos += size;
+    s->out_pos += size;
+    s->stored_left -= size;
+
+    if (s->stored_left == 0)
+        finish_block(s);
+    return ERROR_SUCCESS;
+}
+
+error_t inflate_codes(inflate_state_t* s) {
+    static const uint16_t length_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8_t length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const uint16_t dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const uint8_t dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    while (true) {
+        // What did not fit last time comes first, byte by byte since a match may overlap itself
+        for (; s->match_left && s->out_pos < s->out_size; s->match_left--, s->out_pos++)
+            s->out[s->out_pos] = s->out[s->out_pos - s->match_distance];
+        if (s->literal >= 0 && s->out_pos < s->out_size) {
+            s->out[s->out_pos++] = s->literal;
+            s->literal = -1;
+        }
+        if (s->match_left || s->literal >= 0)
+            return ERROR_SUCCESS;
+
+        int symbol = decode(s, &s->lit);
+
+        if (symbol < 0) {
+            return ERROR_INVALID_FORMAT;
+        }
+        else if (symbol < 256) {
+            if (s->out_pos == s->out_size)
+                s->literal = symbol;
+            else
+                s->out[s->out_pos++] = symbol;
+        }
+        else if (symbol == 256) {
+            finish_block(s);
+            return ERROR_SUCCESS;
+        }
+        else {
+            symbol -= 257;
+            if (symbol >= 29)
+                return ERROR_INVALID_FORMAT;
+            size_t len = length_base[symbol] + get_bits(s, length_extra[symbol]);
+
+            symbol = decode(s, &s->dist);
+            if (symbol < 0 || symbol >= 30)
+                return ERROR_INVALID_FORMAT;
+            size_t distance = dist_base[symbol] + get_bits(s, dist_extra[symbol]);
+
+            if (distance > s->out_pos)
+                return ERROR_INVALID_FORMAT;
+            s->match_left = len;
+            s->match_distance = distance;
+        }
+
+        if (is_overrun(s))
+            return ERROR_INVALID_FORMAT;
+    }
+}
+
+void begin_fixed(inflate_state_t* s) {
+    uint8_t lengths[MAX_LIT_CODES];
+
+    int i = 0;
+    for (; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < 288; i++) lengths[i] = 8;
+    build_huffman(&s->lit, lengths, MAX_LIT_CODES);
+
+    for (i = 0; i < MAX_DIST_CODES; i++) lengths[i] = 5;
+    build_huffman(&s->dist, lengths, MAX_DIST_CODES);
+
+    s->mode = MODE_CODES;
+}
+
+error_t begin_dynamic(inflate_state_t* s) {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    huffman_t lencode;
+    uint8_t lengths[MAX_LIT_CODES + MAX_DIST_CODES] = {0};
+
+    int nlit = get_bits(s, 5) + 257;
+    int ndist = get_bits(s, 5) + 1;
+    int ncode = get_bits(s, 4) + 4;
+    if (nlit > 286 || ndist > MAX_DIST_CODES)
+        return ERROR_INVALID_FORMAT;
+
+    for (int i = 0; i < ncode; i++)
+        lengths[order[i]] = get_bits(s, 3);
+    if (!build_huffman(&lencode, lengths, 19))
+        return ERROR_INVALID_FORMAT;
+
+    memset(lengths, 0, sizeof(lengths));
+    for (int i = 0; i < nlit + ndist;) {
+        int symbol = decode(s, &lencode);
+        if (symbol < 0)
+            return ERROR_INVALID_FORMAT;
+
+        if (symbol < 16) {
+            lengths[i++] = symbol;
+            continue;
+        }
+
+        int repeat;
+        uint8_t len = 0;
+        if (symbol == 16) {
+            if (i == 0)
+                return ERROR_INVALID_FORMAT;
+            len = lengths[i - 1];
+            repeat = 3 + get_bits(s, 2);
+        }
+        else if (symbol == 17) {
+            repeat = 3 + get_bits(s, 3);
+        }
+        else {
+            repeat = 11 + get_bits(s, 7);
+        }
+
+        if (i + repeat > nlit + ndist)
+            return ERROR_INVALID_FORMAT;
+        while (repeat--)
+            lengths[i++] = len;
+    }
+
+    if (lengths[256] == 0)
+        return ERROR_INVALID_FORMAT;
+    if (!build_huffman(&s->lit, lengths, nlit) || !build_huffman(&s->dist, lengths + nlit, ndist))
+        return ERROR_INVALID_FORMAT;
+
+    s->mode = MODE_CODES;
+    return ERROR_SUCCESS;
+}
+
+void finish_block(inflate_state_t* s) {
+    s->mode = (s->is_last) ? (MODE_DONE) : (MODE_HEADER);
+}
@@ -0,0 +1,33 @@
+/* References:
+ *     https://www.rfc-editor.org/rfc/rfc1951
+ */
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+
+/* types */
+// inflate_raw() a piece at a time, only the last 32 KiB of output are kept for the
+// matches to refer to
+typedef struct inflate_stream_t inflate_stream_t;
+
+
+/* function declarations */
+// Decompresses a raw deflate stream (no zlib/gzip header) into `out`.
+// Unlike raylib's sinfl every read and write is bounds-checked, so it is safe
+// to use on archives downloaded from the internet.
+error_t inflate_raw(const void* in, size_t in_size, void* out, size_t out_size, size_t* out_written);
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+
+inflate_stream_t*   inflate_stream_create(const void* in, size_t in_size);  // NULL if out of memory
+void                inflate_stream_destroy(inflate_stream_t* stream);
+// Fills `out` unless the stream ends first, errors are sticky
+error_t             inflate_stream_read(inflate_stream_t* stream, void* out, size_t out_size, size_t* out_read);
+
+
+#endif
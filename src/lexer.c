@@ -0,0 +1,308 @@
+#include "lexer.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define HAS_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define HAS_SSE2 1
+#endif
+
+#include "util.h"
+
+
+/* constants */
+#define COMMENT_PREFIXES    ";#/"
+#define MAX_EXACT_MANTISSA  (1ull << 53)  // integers up to this are exact in a double
+#define MAX_EXACT_POW10     22            // and so are powers of ten up to 1e22
+#define MAX_MANTISSA_DIGITS 19            // fit in uint64_t
+
+
+/* local functions */
+static bool     is_space(char c);
+static bool     is_digit(char c);
+static const char* parse_sign(const char* p, const char* end, bool* is_negative);
+static int      count_trailing_zeros(uint32_t mask);
+#if defined(HAS_SSE2)
+static uint32_t match_16(const char* p, char c);
+#endif
+#if defined(HAS_AVX2)
+static uint32_t match_32(const char* p, char c);
+#endif
+
+
+void lexer_init(lexer_t* lexer, const char* data, size_t size) {
+    assert(lexer != NULL);
+    assert(data != NULL || size == 0);
+
+    lexer->cursor = data;
+    lexer->end = data + size;
+    lexer->lineno = 0;
+}
+
+bool lexer_next_line(lexer_t* lexer, span_t* line) {
+    assert(lexer != NULL);
+    assert(line != NULL);
+
+    while (lexer->cursor < lexer->end) {
+        const char* begin = lexer->cursor;
+        const char* newline = lexer_find(begin, lexer->end, '\n');
+
+        lexer->cursor = (newline < lexer->end) ? (newline + 1) : (lexer->end);
+        lexer->lineno++;
+
+        span_t l = span_trim((span_t){ begin, newline - begin });
+        if (l.size == 0 || strchr(COMMENT_PREFIXES, l.data[0]))
+            continue;
+
+        *line = l;
+        return true;
+    }
+
+    return false;
+}
+
+const char* lexer_find(const char* begin, const char* end, char c) {
+    const char* p = begin;
+
+#if defined(HAS_AVX2)
+    for (; end - p >= 32; p += 32) {
+        uint32_t mask = match_32(p, c);
+        if (mask)
+            return p + count_trailing_zeros(mask);
+    }
+#endif
+#if defined(HAS_SSE2)
+    for (; end - p >= 16; p += 16) {
+        uint32_t mask = match_16(p, c);
+        if (mask)
+            return p + count_trailing_zeros(mask);
+    }
+#endif
+
+    for (; p < end; p++)
+        if (*p == c)
+            return p;
+
+    return end;
+}
+
+int lexer_split(span_t line, char delimiter, span_t* fields, int max_fields) {
+    assert(fields != NULL || max_fields == 0);
+
+    const char* p = line.data;
+    const char* end = line.data + line.size;
+    const char* field = p;
+    int count = 0;
+
+    // Every delimiter in a block is reported by a single compare. Lines in [HitObjects]
+    // are ~30 bytes long, so the 16 byte step matters even when AVX2 is available.
+#if defined(HAS_AVX2)
+    for (; end - p >= 32; p += 32) {
+        for (uint32_t mask = match_32(p, delimiter); mask; mask &= mask - 1) {
+            const char* delim = p + count_trailing_zeros(mask);
+            if (count < max_fields)
+                fields[count] = (span_t){ field, delim - field };
+            count++;
+            field = delim + 1;
+        }
+    }
+#endif
+#if defined(HAS_SSE2)
+    for (; end - p >= 16; p += 16) {
+        for (uint32_t mask = match_16(p, delimiter); mask; mask &= mask - 1) {
+            const char* delim = p + count_trailing_zeros(mask);
+            if (count < max_fields)
+                fields[count] = (span_t){ field, delim - field };
+            count++;
+            field = delim + 1;
+        }
+    }
+#endif
+
+    for (; p < end; p++) {
+        if (*p == delimiter) {
+            if (count < max_fields)
+                fields[count] = (span_t){ field, p - field };
+            count++;
+            field = p + 1;
+        }
+    }
+
+    if (count < max_fields)
+        fields[count] = (span_t){ field, end - field };
+    return count + 1;
+}
+
+span_t span_trim(span_t s) {
+    while (s.size && is_space(s.data[0])) {
+        s.data++;
+        s.size--;
+    }
+    while (s.size && is_space(s.data[s.size - 1]))
+        s.size--;
+    return s;
+}
+
+void span_copy(char* dest, size_t dest_size, span_t s) {
+    assert(dest != NULL);
+    assert(dest_size > 0);
+
+    size_t size = MIN(s.size, dest_size - 1);
+    memcpy(dest, s.data, size);
+    dest[size] = '\0';
+}
+
+const char* lexer_parse_int(const char* begin, const char* end, int* value) {
+    assert(value != NULL);
+
+    bool is_negative;
+    const char* p = parse_sign(begin, end, &is_negative);
+    const char* digits = p;
+
+    // Wraps around on overflow instead of being undefined like atoi()
+    uint32_t v = 0;
+    for (; p < end && is_digit(*p); p++)
+        v = v * 10 + (uint32_t)(*p - '0');
+
+    if (p == digits) {
+        *value = 0;
+        return begin;
+    }
+
+    *value = (int)((is_negative) ? (0u - v) : (v));
+    return p;
+}
+
+const char* lexer_parse_double(const char* begin, const char* end, double* value) {
+    static const double POW10[MAX_EXACT_POW10 + 1] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    assert(value != NULL);
+
+    bool is_negative;
+    const char* p = parse_sign(begin, end, &is_negative);
+
+    uint64_t mantissa = 0;
+    int digit_count = 0;  // significant digits, leading zeros are skipped
+    int exponent = 0;
+    bool has_digits = false;
+
+    for (; p < end && is_digit(*p); p++) {
+        has_digits = true;
+        if (digit_count < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digit_count += mantissa != 0;
+        }
+        else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && is_digit(*p); p++) {
+            has_digits = true;
+            if (digit_count < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digit_count += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!has_digits) {
+        *value = 0;
+        return begin;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        bool is_exponent_negative;
+        const char* q = parse_sign(p + 1, end, &is_exponent_negative);
+        if (q < end && is_digit(*q)) {
+            int e = 0;
+            for (; q < end && is_digit(*q); q++)
+                e = MIN(e * 10 + (*q - '0'), 100000);
+            exponent += (is_exponent_negative) ? (-e) : (e);
+            p = q;
+        }
+    }
+
+    // Both operands are exact, so the single multiplication or division rounds correctly
+    // (same result as strtod). That covers the 15 significant digits osu! writes.
+    double v;
+    if (mantissa == 0)
+        v = 0;
+    else if (mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10)
+        v = (exponent < 0) ? ((double)mantissa / POW10[-exponent]) : ((double)mantissa * POW10[exponent]);
+    else
+        v = (double)mantissa * pow(10.0, exponent);  // may be off by an ulp
+
+    *value = (is_negative) ? (-v) : (v);
+    return p;
+}
+
+int span_to_int(span_t s) {
+    s = span_trim(s);
+
+    int value;
+    lexer_parse_int(s.data, s.data + s.size, &value);
+    return value;
+}
+
+double span_to_double(span_t s) {
+    s = span_trim(s);
+
+    double value;
+    lexer_parse_double(s.data, s.data + s.size, &value);
+    return value;
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool is_digit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+const char* parse_sign(const char* p, const char* end, bool* is_negative) {
+    *is_negative = p < end && *p == '-';
+    return (p < end && (*p == '-' || *p == '+')) ? (p + 1) : (p);
+}
+
+int count_trailing_zeros(uint32_t mask) {
+    assert(mask != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+#if defined(HAS_SSE2)
+uint32_t match_16(const char* p, char c) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+}
+#endif
+
+#if defined(HAS_AVX2)
+uint32_t match_32(const char* p, char c) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c)));
+}
+#endif
@@ -0,0 +1,49 @@
+/* References:
+ *     https://osu.ppy.sh/wiki/en/Client/File_formats/Osu_(file_format)
+ */
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util.h"
+
+
+/* types */
+// Non-owning, NOT null-terminated slice of the file contents
+typedef struct {
+    const char* data;
+    size_t      size;
+} span_t;
+
+// Splits .osu text into lines without copying it. There is no line length limit
+// and the input does not have to be null-terminated (memory-mapped files are not).
+typedef struct {
+    const char* cursor;
+    const char* end;
+    int         lineno;
+} lexer_t;
+
+
+/* function declarations */
+void        lexer_init(lexer_t* lexer, const char* data, size_t size);
+bool        lexer_next_line(lexer_t* lexer, span_t* line);  // skips empty and comment lines, trims whitespace
+
+const char* lexer_find(const char* begin, const char* end, char c);  // returns `end` if not found
+int         lexer_split(span_t line, char delimiter, span_t* fields, int max_fields);  // returns the total field count
+
+// Parse the number at `begin` and return a pointer past it, or `begin` if there is none.
+// They never allocate and ignore the locale: '.' is always the decimal separator.
+// Parsing stops at the first unexpected character, so "123:0:0:" gives 123 and a
+// pointer to the ':'.
+const char* lexer_parse_int(const char* begin, const char* end, int* value);
+const char* lexer_parse_double(const char* begin, const char* end, double* value);
+
+span_t      span_trim(span_t s);
+void        span_copy(char* dest, size_t dest_size, span_t s);
+int         span_to_int(span_t s);  // 0 if `s` does not start with a number, like atoi()
+double      span_to_double(span_t s);
+
+
+#endif
@@ -0,0 +1,563 @@
+#define SCOPE_NAME "library"
+#include "library.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <kvec.h>
+
+#include "util.h"
+#include "beatmap.h"
+#include "cache.h"
+#include "paths.h"
+
+
+/* constants */
+#define CML_MAGIC           "CML"
+#define CML_VERSION         2
+#define INDEX_FILE_NAME     "library.cml"
+#define MAX_PATH_LENGTH     1024
+
+
+/* types */
+typedef struct {
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    entry_size;
+    uint32_t    entry_count;
+    uint32_t    set_size;
+    uint32_t    set_count;
+    uint64_t    strings_size;
+    char        root[512];
+} cml_header_t;
+
+
+/* local functions */
+static void     add_set(library_t* library, const char* set_path);
+static void     insert_set(library_t* library, library_set_t set);
+static void     remove_set(library_t* library, int index);
+static int      find_set(const library_t* library, const char* path, bool* is_found);
+static bool     is_set_path(const char* path);
+static bool     stat_file(const char* path, int64_t* mtime, uint64_t* size);
+static uint32_t add_string(library_t* library, const char* str);
+static void     compact_strings(library_t* library);
+static bool     is_entry_valid(const library_t* library, const library_entry_t* entry);
+static int      compare_paths(const void* a, const void* b);
+static int      compare_entries_by_id(const void* a, const void* b);
+
+
+error_t library_open(library_t* library, const char* root, const char* index_path) {
+    assert(library != NULL);
+    assert(root != NULL);
+    assert(index_path != NULL);
+
+    if (library_load(library, index_path) == ERROR_SUCCESS) {
+        if (strcmp(library->root, root) == 0) {
+            LOGF("loaded %lu difficulties from \"%s\"", kv_size(library->entries), index_path);
+
+            int updated = library_reconcile(library);
+            if (updated) {
+                LOGF("%d sets changed since the index was written", updated);
+                if (library_save(library, index_path) != ERROR_SUCCESS)
+                    LOGF_WARNING("failed to write the index \"%s\"", index_path);
+            }
+            return ERROR_SUCCESS;
+        }
+        library_destroy(library);
+    }
+
+    LOGF("no index for \"%s\", scanning ...", root);
+    CHECK_ERROR_PROPAGATE(library_scan(library, root));
+    if (library_save(library, index_path) != ERROR_SUCCESS)
+        LOGF_WARNING("failed to write the index \"%s\"", index_path);
+
+    return ERROR_SUCCESS;
+}
+
+error_t library_scan(library_t* library, const char* root) {
+    assert(library != NULL);
+    assert(root != NULL);
+
+    memset(library, 0, sizeof(library_t));
+    snprintf(library->root, sizeof(library->root), "%s", root);
+    add_string(library, "");  // offset 0 is the empty string
+
+    path_list_t paths;
+    if (path_list_directory(&paths, root, NULL) != ERROR_SUCCESS) {
+        LOGF("\"%s\" is not a directory or does not exists", root);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    // Sets are added in path order, so ties between equal ids sort the same on every scan
+    qsort(paths.a, kv_size(paths), sizeof(char*), compare_paths);
+    for (int i = 0; i < kv_size(paths); i++)
+        if (is_set_path(kv_A(paths, i)))
+            add_set(library, kv_A(paths, i));
+    path_list_destroy(&paths);
+
+    qsort(library->entries.a, kv_size(library->entries), sizeof(library_entry_t), compare_entries_by_id);
+
+    LOGF_SUCCESS("found %lu difficulties in \"%s\"", kv_size(library->entries), root);
+    return ERROR_SUCCESS;
+}
+
+error_t library_update_set(library_t* library, const char* set_path) {
+    assert(library != NULL);
+    assert(set_path != NULL);
+
+    library_t set;
+    CHECK_ERROR_PROPAGATE(library_read_set(&set, set_path));
+    library_merge_set(library, &set, set_path);
+    library_destroy(&set);
+
+    return ERROR_SUCCESS;
+}
+
+int library_reconcile(library_t* library) {
+    assert(library != NULL);
+
+    // Paths are collected first because updating moves the sets around
+    path_list_t paths;
+    library_list_changed_sets(library, &paths);
+    for (int i = 0; i < kv_size(paths); i++) {
+        LOGF("updating \"%s\"", kv_A(paths, i));
+        library_update_set(library, kv_A(paths, i));
+    }
+
+    int updated = kv_size(paths);
+    path_list_destroy(&paths);
+    return updated;
+}
+
+error_t library_read_set(library_t* set, const char* set_path) {
+    assert(set != NULL);
+    assert(set_path != NULL);
+
+    memset(set, 0, sizeof(library_t));
+    add_string(set, "");
+
+    if (is_set_path(set_path))
+        add_set(set, set_path);
+    return ERROR_SUCCESS;
+}
+
+void library_merge_set(library_t* library, const library_t* set, const char* set_path) {
+    assert(library != NULL);
+    assert(set != NULL);
+    assert(set_path != NULL);
+
+    bool is_found;
+    int index = find_set(library, set_path, &is_found);
+    if (is_found)
+        remove_set(library, index);
+
+    // Strings are copied over once each, the entries of a set share its path and title
+    for (int i = 0; i < kv_size(set->sets); i++) {
+        library_set_t s = kv_A(set->sets, i);
+        uint32_t path = s.path;
+        s.path = add_string(library, library_string(set, path));
+        insert_set(library, s);
+
+        uint32_t title = 0;
+        bool is_title_added = false;
+        for (int j = 0; j < kv_size(set->entries); j++) {
+            library_entry_t entry = kv_A(set->entries, j);
+            if (entry.set_path != path)
+                continue;
+
+            if (!is_title_added)
+                title = add_string(library, library_string(set, entry.title));
+            is_title_added = true;
+
+            entry.title = title;
+            entry.version = add_string(library, library_string(set, entry.version));
+            entry.audio_filename = add_string(library, library_string(set, entry.audio_filename));
+            entry.set_path = s.path;
+            entry.path = add_string(library, library_string(set, entry.path));
+            kv_push(library_entry_t, library->entries, entry);
+        }
+    }
+    qsort(library->entries.a, kv_size(library->entries), sizeof(library_entry_t), compare_entries_by_id);
+
+    if (library->unused_strings_size > kv_size(library->strings) / 2)
+        compact_strings(library);
+}
+
+error_t library_list_changed_sets(const library_t* library, path_list_t* paths) {
+    assert(library != NULL);
+    assert(paths != NULL);
+
+    enum { SET_MISSING, SET_SEEN, SET_STALE };
+
+    // Only metadata is compared, nothing is read unless it changed
+    kv_init(*paths);
+
+    char* states = calloc(kv_size(library->sets) + 1, 1);
+    if (states == NULL) {
+        LOG("out of memory while looking for changed sets");
+        return ERROR_UNDEFINED;
+    }
+
+    path_list_t files;
+    error_t err = path_list_directory(&files, library->root, NULL);
+    if (err != ERROR_SUCCESS) {
+        LOGF("could not list \"%s\", keeping every set", library->root);
+        free(states);
+        return err;
+    }
+    for (int i = 0; i < kv_size(files); i++) {
+        const char* path = kv_A(files, i);
+        if (!is_set_path(path))
+            continue;
+
+        bool is_found;
+        int index = find_set(library, path, &is_found);
+        if (!is_found) {
+            kv_push(char*, *paths, strdup(path));
+            continue;
+        }
+
+        library_set_t* set = &kv_A(library->sets, index);
+        int64_t mtime;
+        uint64_t size;
+        bool is_same = stat_file(path, &mtime, &size) && mtime == set->mtime && size == set->size;
+        states[index] = (is_same) ? (SET_SEEN) : (SET_STALE);
+    }
+    path_list_destroy(&files);
+
+    // Files edited in place leave the folder mtime alone
+    for (int i = 0; i < kv_size(library->entries); i++) {
+        library_entry_t* entry = &kv_A(library->entries, i);
+
+        bool is_found;
+        int index = find_set(library, library_string(library, entry->set_path), &is_found);
+        if (!is_found || states[index] != SET_SEEN || kv_A(library->sets, index).size)
+            continue;  // .osz sets were already compared as a whole
+
+        int64_t mtime;
+        uint64_t size;
+        if (!stat_file(library_string(library, entry->path), &mtime, &size) || mtime != entry->mtime || size != entry->size)
+            states[index] = SET_STALE;
+    }
+
+    for (int i = 0; i < kv_size(library->sets); i++)
+        if (states[i] != SET_SEEN)
+            kv_push(char*, *paths, strdup(library_string(library, kv_A(library->sets, i).path)));
+    free(states);
+    return ERROR_SUCCESS;
+}
+
+error_t library_load(library_t* library, const char* index_path) {
+    assert(library != NULL);
+    assert(index_path != NULL);
+
+    memset(library, 0, sizeof(library_t));
+
+    FILE* file = fopen(index_path, "rb");
+    if (file == NULL)
+        return ERROR_FILE_NOT_FOUND;
+
+    cml_header_t header;
+    bool is_valid = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, CML_MAGIC, sizeof(header.magic)) == 0
+        && header.version == CML_VERSION
+        && header.entry_size == sizeof(library_entry_t)
+        && header.set_size == sizeof(library_set_t)
+        && header.strings_size > 0 && header.strings_size <= UINT32_MAX
+        && memchr(header.root, '\0', sizeof(header.root)) != NULL;
+
+    if (is_valid) {
+        kv_resize(library_entry_t, library->entries, header.entry_count);
+        kv_resize(library_set_t, library->sets, header.set_count);
+        kv_resize(char, library->strings, header.strings_size);
+        is_valid = fread(library->entries.a, sizeof(library_entry_t), header.entry_count, file) == header.entry_count
+            && fread(library->sets.a, sizeof(library_set_t), header.set_count, file) == header.set_count
+            && fread(library->strings.a, 1, header.strings_size, file) == header.strings_size;
+        kv_size(library->entries) = header.entry_count;
+        kv_size(library->sets) = header.set_count;
+        kv_size(library->strings) = header.strings_size;
+    }
+    fclose(file);
+
+    // Everything is read back as is, so a damaged index must not hand out bad offsets
+    is_valid = is_valid && kv_A(library->strings, kv_size(library->strings) - 1) == '\0';
+    for (int i = 0; is_valid && i < kv_size(library->entries); i++)
+        is_valid = is_entry_valid(library, &kv_A(library->entries, i));
+    for (int i = 0; is_valid && i < kv_size(library->sets); i++)
+        is_valid = kv_A(library->sets, i).path < kv_size(library->strings);
+
+    if (!is_valid) {
+        library_destroy(library);
+        return ERROR_INVALID_FORMAT;
+    }
+
+    memcpy(library->root, header.root, sizeof(library->root));
+    return ERROR_SUCCESS;
+}
+
+error_t library_save(const library_t* library, const char* index_path) {
+    assert(library != NULL);
+    assert(index_path != NULL);
+
+    char temp_path[MAX_PATH_LENGTH + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+
+    cml_header_t header = {
+        .magic          = CML_MAGIC,
+        .version        = CML_VERSION,
+        .entry_size     = sizeof(library_entry_t),
+        .entry_count    = kv_size(library->entries),
+        .set_size       = sizeof(library_set_t),
+        .set_count      = kv_size(library->sets),
+        .strings_size   = kv_size(library->strings),
+    };
+    memcpy(header.root, library->root, sizeof(header.root));
+
+    FILE* file = fopen(temp_path, "wb");
+    if (file == NULL)
+        return ERROR_FILE_NOT_FOUND;
+
+    bool is_written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(library->entries.a, sizeof(library_entry_t), kv_size(library->entries), file) == kv_size(library->entries)
+        && fwrite(library->sets.a, sizeof(library_set_t), kv_size(library->sets), file) == kv_size(library->sets)
+        && fwrite(library->strings.a, 1, kv_size(library->strings), file) == kv_size(library->strings);
+    is_written = (fclose(file) == 0) && is_written;
+
+    if (!is_written || rename(temp_path, index_path) != 0) {
+        remove(temp_path);
+        return ERROR_UNDEFINED;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+void library_destroy(library_t* library) {
+    assert(library != NULL);
+
+    kv_destroy(library->entries);
+    kv_destroy(library->sets);
+    kv_destroy(library->strings);
+    memset(library, 0, sizeof(library_t));
+}
+
+const library_entry_t* library_find(const library_t* library, uint32_t id) {
+    assert(library != NULL);
+
+    if (id == 0)
+        return NULL;
+
+    // First entry with an id >= `id`
+    int lo = 0, hi = kv_size(library->entries);
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (kv_A(library->entries, mid).id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < kv_size(library->entries) && kv_A(library->entries, lo).id == id) ? (&kv_A(library->entries, lo)) : (NULL);
+}
+
+const char* library_string(const library_t* library, uint32_t offset) {
+    assert(library != NULL);
+    assert(offset < kv_size(library->strings));
+
+    return library->strings.a + offset;
+}
+
+bool library_get_default_path(char* path, size_t size) {
+    assert(path != NULL);
+
+    char directory[MAX_PATH_LENGTH];
+    if (!cache_get_directory(directory, sizeof(directory)))
+        return false;
+
+    int length = snprintf(path, size, "%s/%s", directory, INDEX_FILE_NAME);
+    return length > 0 && (size_t)length < size;
+}
+
+void add_set(library_t* library, const char* set_path) {
+    library_set_t set = {
+        .path = add_string(library, set_path),
+    };
+    stat_file(set_path, &set.mtime, &set.size);
+    insert_set(library, set);
+
+    beatmap_t beatmap;
+    if (beatmap_load_metadata(&beatmap, set_path) != ERROR_SUCCESS) {
+        LOGF_WARNING("skipping \"%s\"", set_path);
+        return;
+    }
+
+    bool is_archive = beatmap.archive != NULL;
+    uint32_t title = add_string(library, beatmap.title);
+    for (int i = 0; i < kv_size(beatmap.difficulties); i++) {
+        difficulty_t* d = &kv_A(beatmap.difficulties, i);
+
+        library_entry_t entry = {
+            .set_id         = beatmap.id,
+            .id             = d->id,
+            .CS             = d->CS,
+            .title          = title,
+            .version        = add_string(library, d->name),
+            .audio_filename = add_string(library, d->audio_filename),
+            .set_path       = set.path,
+            .path           = add_string(library, d->path),
+            .mtime          = set.mtime,
+            .size           = set.size,
+        };
+        if (!is_archive)
+            stat_file(d->path, &entry.mtime, &entry.size);
+        kv_push(library_entry_t, library->entries, entry);
+    }
+
+    beatmap_destroy(&beatmap);
+}
+
+void insert_set(library_t* library, library_set_t set) {
+    bool is_found;
+    int index = find_set(library, library_string(library, set.path), &is_found);
+    assert(!is_found);
+    kv_push(library_set_t, library->sets, set);
+    memmove(&kv_A(library->sets, index + 1), &kv_A(library->sets, index), (kv_size(library->sets) - index - 1) * sizeof(library_set_t));
+    kv_A(library->sets, index) = set;
+}
+
+void remove_set(library_t* library, int index) {
+    uint32_t path = kv_A(library->sets, index).path;
+    library->unused_strings_size += strlen(library_string(library, path)) + 1;
+
+    // Entries stay in id order, all of them share one title
+    int count = 0;
+    bool is_title_counted = false;
+    for (int i = 0; i < kv_size(library->entries); i++) {
+        library_entry_t* entry = &kv_A(library->entries, i);
+        if (entry->set_path == path) {
+            library->unused_strings_size += strlen(library_string(library, entry->version)) + 1
+                + strlen(library_string(library, entry->audio_filename)) + 1
+                + strlen(library_string(library, entry->path)) + 1;
+            if (!is_title_counted)
+                library->unused_strings_size += strlen(library_string(library, entry->title)) + 1;
+            is_title_counted = true;
+            continue;
+        }
+        kv_A(library->entries, count++) = *entry;
+    }
+    kv_size(library->entries) = count;
+
+    memmove(&kv_A(library->sets, index), &kv_A(library->sets, index + 1), (kv_size(library->sets) - index - 1) * sizeof(library_set_t));
+    kv_size(library->sets)--;
+}
+
+int find_set(const library_t* library, const char* path, bool* is_found) {
+    // First set with a path >= `path`
+    int lo = 0, hi = kv_size(library->sets);
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(library_string(library, kv_A(library->sets, mid).path), path) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *is_found = lo < kv_size(library->sets) && strcmp(library_string(library, kv_A(library->sets, lo).path), path) == 0;
+    return lo;
+}
+
+bool is_set_path(const char* path) {
+    return path_is_directory(path) || (path_has_extension(path, ".osz") && path_is_file(path));
+}
+
+bool stat_file(const char* path, int64_t* mtime, uint64_t* size) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *mtime = 0;
+        *size = 0;
+        return false;
+    }
+
+    *mtime = (int64_t)st.st_mtime;
+    *size = (S_ISDIR(st.st_mode)) ? (0) : ((uint64_t)st.st_size);
+    return true;
+}
+
+uint32_t add_string(library_t* library, const char* str) {
+    uint32_t offset = kv_size(library->strings);
+    for (const char* p = str; ; p++) {
+        kv_push(char, library->strings, *p);
+        if (*p == '\0')
+            break;
+    }
+    return offset;
+}
+
+void compact_strings(library_t* library) {
+    // Maps old offsets to new ones, 0 is the empty string in both tables so it
+    // doubles as "not copied yet"
+    uint32_t* offsets = calloc(kv_size(library->strings), sizeof(uint32_t));
+    if (offsets == NULL)
+        return;
+
+    kvec_t(char) strings;
+    kv_init(strings);
+    kv_push(char, strings, '\0');
+
+    #define COMPACT(offset) do {                                                            \
+            if ((offset) && !offsets[offset]) {                                             \
+                const char* str = library_string(library, offset);                          \
+                size_t size = strlen(str) + 1;                                              \
+                offsets[offset] = kv_size(strings);                                         \
+                if (kv_size(strings) + size > kv_max(strings))                              \
+                    kv_resize(char, strings, MAX(kv_max(strings) * 2, kv_size(strings) + size)); \
+                memcpy(strings.a + kv_size(strings), str, size);                            \
+                kv_size(strings) += size;                                                   \
+            }                                                                               \
+            (offset) = offsets[offset];                                                     \
+        } while (0)
+
+    for (int i = 0; i < kv_size(library->sets); i++)
+        COMPACT(kv_A(library->sets, i).path);
+    for (int i = 0; i < kv_size(library->entries); i++) {
+        library_entry_t* entry = &kv_A(library->entries, i);
+        COMPACT(entry->title);
+        COMPACT(entry->version);
+        COMPACT(entry->audio_filename);
+        COMPACT(entry->set_path);
+        COMPACT(entry->path);
+    }
+
+    #undef COMPACT
+
+    free(offsets);
+    kv_destroy(library->strings);
+    library->strings.a = strings.a;
+    library->strings.n = strings.n;
+    library->strings.m = strings.m;
+    library->unused_strings_size = 0;
+}
+
+bool is_entry_valid(const library_t* library, const library_entry_t* entry) {
+    size_t size = kv_size(library->strings);
+    return entry->title < size
+        && entry->version < size
+        && entry->audio_filename < size
+        && entry->set_path < size
+        && entry->path < size;
+}
+
+int compare_paths(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+int compare_entries_by_id(const void* a, const void* b) {
+    const library_entry_t* ea = (const library_entry_t*)a;
+    const library_entry_t* eb = (const library_entry_t*)b;
+    if (ea->id != eb->id)
+        return (ea->id < eb->id) ? (-1) : (1);
+    // Strings are appended in scan order
+    return (ea->path > eb->path) - (ea->path < eb->path);
+}
@@ -0,0 +1,72 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kvec.h>
+
+#include "util.h"
+#include "paths.h"
+
+
+/* types */
+// One difficulty of the song library. Strings are offsets into `library_t.strings`,
+// read them with library_string().
+typedef struct {
+    uint32_t    set_id;
+    uint32_t    id;
+    float       CS;
+    uint32_t    title;
+    uint32_t    version;
+    uint32_t    audio_filename;
+    uint32_t    set_path;  // folder or .osz to pass to beatmap_load()
+    uint32_t    path;      // the .osu, or its entry name inside the .osz
+    int64_t     mtime;     // of the .osu, or of the whole .osz
+    uint64_t    size;
+} library_entry_t;
+
+// A folder or .osz below the Songs folder, also kept when none of its difficulties
+// could be parsed so it is not rescanned on every start
+typedef struct {
+    uint32_t    path;
+    int64_t     mtime;  // a folder's mtime changes when files are added or removed
+    uint64_t    size;   // 0 for folders
+} library_set_t;
+
+// Index of every difficulty below a Songs folder. It is persisted as a single file,
+// so startup only reads that file instead of opening every .osu.
+typedef struct {
+    char                        root[512];
+    kvec_t(library_entry_t)     entries;  // sorted by id
+    kvec_t(library_set_t)       sets;     // sorted by path
+    kvec_t(char)                strings;
+    size_t                      unused_strings_size;  // left behind by library_update_set()
+} library_t;
+
+
+/* function declarations */
+// Loads the index at `index_path` if it was built for `root` and reconciles it,
+// otherwise scans `root`. The index is written back when anything changed.
+error_t     library_open(library_t* library, const char* root, const char* index_path);
+error_t     library_scan(library_t* library, const char* root);  // every folder and .osz directly inside `root`
+error_t     library_update_set(library_t* library, const char* set_path);  // re-parses or removes one set
+int         library_reconcile(library_t* library);  // updates sets whose mtime or size changed, returns how many
+// library_update_set() and library_reconcile() in steps, so the parsing can happen
+// while others still read `library`. Reading a set only touches `set`, an empty
+// library if the set is gone, merging replaces `set_path` in `library` with it.
+error_t     library_read_set(library_t* set, const char* set_path);
+void        library_merge_set(library_t* library, const library_t* set, const char* set_path);
+// `paths` stays empty when the root can not be listed, so no set is taken as removed
+error_t     library_list_changed_sets(const library_t* library, path_list_t* paths);
+error_t     library_load(library_t* library, const char* index_path);
+error_t     library_save(const library_t* library, const char* index_path);
+void        library_destroy(library_t* library);
+
+const library_entry_t* library_find(const library_t* library, uint32_t id);  // NULL if not found, 0 is never found
+const char* library_string(const library_t* library, uint32_t offset);
+bool        library_get_default_path(char* path, size_t size);  // inside the cache directory
+
+
+#endif
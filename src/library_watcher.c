@@ -0,0 +1,294 @@
+#define SCOPE_NAME "library watcher"
+#include "library_watcher.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <unistd.h>
+    #include <sys/inotify.h>
+    #define HAS_INOTIFY 1
+#endif
+
+#include <kvec.h>
+
+#include "util.h"
+#include "paths.h"
+#include "library.h"
+
+
+#if defined(HAS_INOTIFY)
+
+/* constants */
+#define ROOT_EVENTS         (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR)
+#define SET_EVENTS          (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_ONLYDIR)
+#define POLL_TIMEOUT_MS     200   // how long stopping may take
+#define SETTLE_TIME_US      500000  // osu! extracts a set file by file, wait for it to finish
+#define EVENT_BUFFER_SIZE   16384
+
+
+/* local functions */
+static void*    read_events(void* arg);
+static void*    update_library(void* arg);
+static void     update_set(library_watcher_t* watcher, const char* path);
+static void     reconcile(library_watcher_t* watcher);
+static void     add_watch(library_watcher_t* watcher, const char* path);
+static void     remove_watch(library_watcher_t* watcher, int wd);
+static int      find_watch(library_watcher_t* watcher, int wd);
+static void     push_path(library_watcher_t* watcher, const char* path);
+
+
+error_t library_watcher_start(library_watcher_t* watcher, library_t* library, const char* index_path) {
+    assert(watcher != NULL);
+    assert(library != NULL);
+    assert(index_path != NULL);
+
+    memset(watcher, 0, sizeof(library_watcher_t));
+    watcher->library = library;
+    snprintf(watcher->index_path, sizeof(watcher->index_path), "%s", index_path);
+
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        LOGF("inotify_init1() failed: %s", strerror(errno));
+        return ERROR_UNDEFINED;
+    }
+
+    // The root sees sets come and go, each set folder sees its .osu files change
+    add_watch(watcher, library->root);
+    if (kv_size(watcher->watches) == 0) {
+        close(watcher->fd);
+        return ERROR_FILE_NOT_FOUND;
+    }
+    for (int i = 0; i < kv_size(library->sets); i++) {
+        const char* path = library_string(library, kv_A(library->sets, i).path);
+        if (kv_A(library->sets, i).size == 0)
+            add_watch(watcher, path);
+    }
+    LOGF("watching %lu folders below \"%s\"", kv_size(watcher->watches), library->root);
+
+    pthread_mutex_init(&watcher->lock, NULL);
+    pthread_cond_init(&watcher->cond, NULL);
+    atomic_init(&watcher->is_running, true);
+
+    if (pthread_create(&watcher->reader, NULL, read_events, watcher) != 0) {
+        library_watcher_stop(watcher);
+        return ERROR_UNDEFINED;
+    }
+    if (pthread_create(&watcher->worker, NULL, update_library, watcher) != 0) {
+        atomic_store(&watcher->is_running, false);
+        pthread_join(watcher->reader, NULL);
+        watcher->reader = 0;
+        library_watcher_stop(watcher);
+        return ERROR_UNDEFINED;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+void library_watcher_stop(library_watcher_t* watcher) {
+    assert(watcher != NULL);
+
+    pthread_mutex_lock(&watcher->lock);
+    atomic_store(&watcher->is_running, false);
+    pthread_cond_broadcast(&watcher->cond);
+    pthread_mutex_unlock(&watcher->lock);
+
+    if (watcher->reader)
+        pthread_join(watcher->reader, NULL);
+    if (watcher->worker)
+        pthread_join(watcher->worker, NULL);
+
+    path_list_destroy(&watcher->queue);
+    kv_destroy(watcher->watches);
+    close(watcher->fd);
+
+    pthread_cond_destroy(&watcher->cond);
+    pthread_mutex_destroy(&watcher->lock);
+    memset(watcher, 0, sizeof(library_watcher_t));
+}
+
+void* read_events(void* arg) {
+    library_watcher_t* watcher = (library_watcher_t*)arg;
+
+    char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[1024];
+
+    while (atomic_load(&watcher->is_running)) {
+        struct pollfd pfd = { .fd = watcher->fd, .events = POLLIN };
+        if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0)
+            continue;
+
+        ssize_t size = read(watcher->fd, buffer, sizeof(buffer));
+        for (char* p = buffer; size > 0 && p < buffer + size; ) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                push_path(watcher, NULL);
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                remove_watch(watcher, event->wd);
+                continue;
+            }
+
+            int index = find_watch(watcher, event->wd);
+            if (index < 0 || event->len == 0)
+                continue;
+
+            const char* directory = kv_A(watcher->watches, index).path;
+            bool is_root = index == 0;
+            bool is_dir = event->mask & IN_ISDIR;
+            snprintf(path, sizeof(path), "%s/%s", directory, event->name);
+
+            if (is_root && is_dir && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                add_watch(watcher, path);
+
+            if (is_root && (is_dir || path_has_extension(event->name, ".osz")))
+                push_path(watcher, path);
+            else if (!is_root && path_has_extension(event->name, ".osu"))
+                push_path(watcher, directory);
+        }
+    }
+
+    return NULL;
+}
+
+void* update_library(void* arg) {
+    library_watcher_t* watcher = (library_watcher_t*)arg;
+
+    pthread_mutex_lock(&watcher->lock);
+    while (true) {
+        while (kv_size(watcher->queue) == 0 && atomic_load(&watcher->is_running))
+            pthread_cond_wait(&watcher->cond, &watcher->lock);
+        if (!atomic_load(&watcher->is_running))
+            break;
+
+        pthread_mutex_unlock(&watcher->lock);
+        usleep(SETTLE_TIME_US);
+        pthread_mutex_lock(&watcher->lock);
+
+        // Events for one set come in bursts, the queue only holds each path once.
+        // New events queue up again while these are handled.
+        path_list_t paths = watcher->queue;
+        kv_init(watcher->queue);
+        pthread_mutex_unlock(&watcher->lock);
+
+        // Only this thread changes the library, so reading it needs no lock
+        for (int i = 0; i < kv_size(paths) && atomic_load(&watcher->is_running); i++) {
+            if (kv_A(paths, i))
+                update_set(watcher, kv_A(paths, i));
+            else
+                reconcile(watcher);
+        }
+        path_list_destroy(&paths);
+
+        if (library_save(watcher->library, watcher->index_path) != ERROR_SUCCESS)
+            LOGF_WARNING("failed to write the index \"%s\"", watcher->index_path);
+
+        pthread_mutex_lock(&watcher->lock);
+    }
+    pthread_mutex_unlock(&watcher->lock);
+
+    return NULL;
+}
+
+void update_set(library_watcher_t* watcher, const char* path) {
+    LOGF("updating \"%s\"", path);
+
+    library_t set;
+    if (library_read_set(&set, path) != ERROR_SUCCESS)
+        return;
+
+    pthread_mutex_lock(&watcher->lock);
+    library_merge_set(watcher->library, &set, path);
+    pthread_mutex_unlock(&watcher->lock);
+
+    library_destroy(&set);
+}
+
+void reconcile(library_watcher_t* watcher) {
+    path_list_t paths;
+    library_list_changed_sets(watcher->library, &paths);
+    for (int i = 0; i < kv_size(paths) && atomic_load(&watcher->is_running); i++)
+        update_set(watcher, kv_A(paths, i));
+    path_list_destroy(&paths);
+}
+
+void add_watch(library_watcher_t* watcher, const char* path) {
+    library_watch_t watch = {
+        .wd = inotify_add_watch(watcher->fd, path, (kv_size(watcher->watches) == 0) ? (ROOT_EVENTS) : (SET_EVENTS)),
+    };
+
+    // Usually fs.inotify.max_user_watches, the startup reconciliation still catches those sets
+    if (watch.wd < 0) {
+        LOGF_WARNING("cannot watch \"%s\": %s", path, strerror(errno));
+        return;
+    }
+
+    snprintf(watch.path, sizeof(watch.path), "%s", path);
+    kv_push(library_watch_t, watcher->watches, watch);
+}
+
+void remove_watch(library_watcher_t* watcher, int wd) {
+    int index = find_watch(watcher, wd);
+    if (index <= 0)
+        return;  // the root stays, its events just stop
+
+    kv_A(watcher->watches, index) = kv_A(watcher->watches, kv_size(watcher->watches) - 1);
+    kv_size(watcher->watches)--;
+}
+
+int find_watch(library_watcher_t* watcher, int wd) {
+    for (int i = 0; i < kv_size(watcher->watches); i++)
+        if (kv_A(watcher->watches, i).wd == wd)
+            return i;
+    return -1;
+}
+
+void push_path(library_watcher_t* watcher, const char* path) {
+    pthread_mutex_lock(&watcher->lock);
+
+    bool is_queued = false;
+    for (int i = 0; i < kv_size(watcher->queue) && !is_queued; i++) {
+        const char* queued = kv_A(watcher->queue, i);
+        is_queued = (path && queued) ? (strcmp(queued, path) == 0) : (path == queued);
+    }
+    if (!is_queued)
+        kv_push(char*, watcher->queue, (path) ? (strdup(path)) : (NULL));
+
+    pthread_cond_signal(&watcher->cond);
+    pthread_mutex_unlock(&watcher->lock);
+}
+
+#else
+
+error_t library_watcher_start(library_watcher_t* watcher, library_t* library, const char* index_path) {
+    assert(watcher != NULL);
+
+    memset(watcher, 0, sizeof(library_watcher_t));
+    LOG("not supported on this platform");
+    return ERROR_UNDEFINED;
+}
+
+void library_watcher_stop(library_watcher_t* watcher) {
+    assert(watcher != NULL);
+}
+
+#endif
+
+void library_watcher_lock(library_watcher_t* watcher) {
+    assert(watcher != NULL);
+
+    pthread_mutex_lock(&watcher->lock);
+}
+
+void library_watcher_unlock(library_watcher_t* watcher) {
+    assert(watcher != NULL);
+
+    pthread_mutex_unlock(&watcher->lock);
+}
@@ -0,0 +1,49 @@
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <kvec.h>
+
+#include "util.h"
+#include "library.h"
+
+
+/* types */
+typedef struct {
+    int     wd;
+    char    path[512];
+} library_watch_t;
+
+// Keeps a library up to date while the game runs. An inotify reader queues the
+// folders and .osz files that changed, a worker re-parses only those and writes
+// the index back. Linux only, elsewhere library_open() catches changes on start.
+typedef struct {
+    library_t*                  library;
+    char                        index_path[1024];
+
+    int                         fd;
+    kvec_t(library_watch_t)     watches;
+    path_list_t                 queue;  // set paths, NULL asks for a full reconcile
+
+    pthread_t                   reader;
+    pthread_t                   worker;
+    pthread_mutex_t             lock;  // guards the queue and changes to the library
+    pthread_cond_t              cond;
+    atomic_bool                 is_running;
+} library_watcher_t;
+
+
+/* function declarations */
+error_t library_watcher_start(library_watcher_t* watcher, library_t* library, const char* index_path);
+void    library_watcher_stop(library_watcher_t* watcher);
+
+// Hold the lock while reading the library. The worker parses without it and only
+// takes it to swap the updated sets in.
+void    library_watcher_lock(library_watcher_t* watcher);
+void    library_watcher_unlock(library_watcher_t* watcher);
+
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
@@ -9,19 +10,35 @@
 #include "util.h"
 #include "beatmap.h"
 #include "playfield.h"
+#include "library.h"
 
 
 static beatmap_t beatmap;
 static playfield_t playfield;
+static library_t library;
+
+
+/* local functions */
+static void open_library(const char* root, const char* id);
 
 int main(int argc, const char *argv[]) {
     logging_init();
 
     if (argc <= 1) {
         printf("Usage: %s <.osz/folder>\n", GetFileName(argv[0]));
+        printf("       %s --library <Songs folder> [difficulty id]\n", GetFileName(argv[0]));
         exit(0);
     }
 
+    if (strcmp(argv[1], "--library") == 0) {
+        if (argc <= 2) {
+            printf("Usage: %s --library <Songs folder> [difficulty id]\n", GetFileName(argv[0]));
+            exit(0);
+        }
+        open_library(argv[2], (argc > 3) ? (argv[3]) : (NULL));
+        return 0;
+    }
+
     CHECK_ERROR(beatmap_load(&beatmap, argv[1]));
     beatmap_debug_print(&beatmap);
 
@@ -30,3 +47,30 @@ int main(int argc, const char *argv[]) {
 
     return 0;
 }
+
+void open_library(const char* root, const char* id) {
+    char index_path[1024];
+    if (!library_get_default_path(index_path, sizeof(index_path))) {
+        LOG_ERROR("no cache directory for the library index");
+        exit(-1);
+    }
+
+    CHECK_ERROR(library_open(&library, root, index_path));
+    if (id == NULL)
+        return;
+
+    const library_entry_t* entry = library_find(&library, (uint32_t)strtoul(id, NULL, 10));
+    if (entry == NULL) {
+        LOGF_ERROR("no difficulty with id %s", id);
+        exit(-1);
+    }
+
+    CHECK_ERROR(beatmap_load(&beatmap, library_string(&library, entry->set_path)));
+    for (int i = 0; i < kv_size(beatmap.difficulties); i++) {
+        if (kv_A(beatmap.difficulties, i).id == entry->id) {
+            CHECK_ERROR(playfield_create_from(&kv_A(beatmap.difficulties, i), &playfield));
+            playfield_debug_print(&playfield);
+            break;
+        }
+    }
+}
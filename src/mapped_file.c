@@ -0,0 +1,121 @@
+#define SCOPE_NAME "file loader"
+#include "mapped_file.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #define HAS_MMAP 1
+#else
+    #define HAS_MMAP 0
+#endif
+
+#include "util.h"
+
+
+/* constants */
+#define READ_CHUNK_SIZE 65536
+
+
+/* local functions */
+static error_t read_stream(mapped_file_t* file, FILE* stream);
+
+
+error_t mapped_file_load(mapped_file_t* file, const char* path) {
+    assert(file != NULL);
+    assert(path != NULL);
+
+    memset(file, 0, sizeof(mapped_file_t));
+
+#if HAS_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ERROR_FILE_NOT_FOUND;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+        #if defined(MADV_SEQUENTIAL)
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+        #endif
+            close(fd);
+            file->data = data;
+            file->size = st.st_size;
+            file->is_mapped = true;
+            return ERROR_SUCCESS;
+        }
+    }
+
+    // Not a regular file or could not be mapped, fall back to buffered reads
+    FILE* stream = fdopen(fd, "rb");
+    if (stream == NULL) {
+        close(fd);
+        return ERROR_UNDEFINED;
+    }
+#else
+    FILE* stream = fopen(path, "rb");
+    if (stream == NULL)
+        return ERROR_FILE_NOT_FOUND;
+#endif
+
+    error_t err = read_stream(file, stream);
+    fclose(stream);
+    return err;
+}
+
+void mapped_file_unload(mapped_file_t* file) {
+    assert(file != NULL);
+
+#if HAS_MMAP
+    if (file->is_mapped)
+        munmap((void*)file->data, file->size);
+    else
+#endif
+        free((void*)file->data);
+
+    memset(file, 0, sizeof(mapped_file_t));
+}
+
+error_t read_stream(mapped_file_t* file, FILE* stream) {
+    assert(file != NULL);
+    assert(stream != NULL);
+
+    // Size can not be known upfront for pipes, so grow the buffer as we go
+    char* data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    while (true) {
+        if (size == capacity) {
+            capacity = (capacity) ? (capacity * 2) : (READ_CHUNK_SIZE);
+            char* new_data = realloc(data, capacity);
+            if (new_data == NULL) {
+                free(data);
+                return ERROR_UNDEFINED;
+            }
+            data = new_data;
+        }
+
+        size_t count = fread(data + size, 1, capacity - size, stream);
+        size += count;
+        if (count == 0)
+            break;
+    }
+
+    if (ferror(stream)) {
+        free(data);
+        return ERROR_UNDEFINED;
+    }
+
+    file->data = data;
+    file->size = size;
+    file->is_mapped = false;
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,26 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util.h"
+
+
+/* types */
+// Read-only view of a whole file. Regular files are memory-mapped, everything
+// else (pipes, character devices, platforms without mmap) is read into the heap.
+// The data is NOT null-terminated.
+typedef struct {
+    const char* data;
+    size_t      size;
+    bool        is_mapped;
+} mapped_file_t;
+
+
+/* function declarations */
+error_t mapped_file_load(mapped_file_t* file, const char* path);
+void    mapped_file_unload(mapped_file_t* file);
+
+
+#endif
@@ -0,0 +1,86 @@
+/* Generated by tools/gen_osu_keys.py, do not edit. */
+#include "osu_keys.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+/* types */
+typedef struct {
+    const char* name;
+    size_t      length;
+    int         value;
+} osu_name_t;
+
+
+/* local functions */
+static uint32_t osu_hash(span_t s, uint32_t k0, uint32_t k1, uint32_t k2, uint32_t k3, uint32_t mask);
+static int      lookup(const osu_name_t* table, uint32_t h, span_t name, int unknown);
+
+
+static const osu_name_t SECTIONS[8] = {
+    [0] = { "Difficulty", 10, SECTION_DIFFICULTY },
+    [1] = { "HitObjects", 10, SECTION_HITOBJECTS },
+    [2] = { "Metadata", 8, SECTION_METADATA },
+    [3] = { "TimingPoints", 12, SECTION_TIMING_POINTS },
+    [4] = { "General", 7, SECTION_GENERAL },
+    [5] = { "Colours", 7, SECTION_COLOURS },
+    [6] = { "Events", 6, SECTION_EVENTS },
+    [7] = { "Editor", 6, SECTION_EDITOR },
+};
+
+osu_section_t osu_find_section(span_t name) {
+    uint32_t h = osu_hash(name, 60, 157, 77, 157, 7);
+    return (osu_section_t)lookup(SECTIONS, h, name, SECTION_UNKNOWN);
+}
+
+static const osu_name_t KEYS[64] = {
+    [0] = { "Mode", 4, KEY_MODE },
+    [1] = { "Title", 5, KEY_TITLE },
+    [7] = { "Tags", 4, KEY_TAGS },
+    [8] = { "Version", 7, KEY_VERSION },
+    [11] = { "Countdown", 9, KEY_COUNTDOWN },
+    [12] = { "ArtistUnicode", 13, KEY_ARTIST_UNICODE },
+    [14] = { "CircleSize", 10, KEY_CS },
+    [15] = { "LetterboxInBreaks", 17, KEY_LETTERBOX_IN_BREAKS },
+    [18] = { "SpecialStyle", 12, KEY_SPECIAL_STYLE },
+    [19] = { "Artist", 6, KEY_ARTIST },
+    [21] = { "WidescreenStoryboard", 20, KEY_WIDESCREEN_STORYBOARD },
+    [24] = { "ApproachRate", 12, KEY_AR },
+    [25] = { "HPDrainRate", 11, KEY_HP },
+    [26] = { "OverallDifficulty", 17, KEY_OD },
+    [27] = { "Creator", 7, KEY_CREATOR },
+    [28] = { "AudioFilename", 13, KEY_AUDIO_FILENAME },
+    [29] = { "TitleUnicode", 12, KEY_TITLE_UNICODE },
+    [33] = { "PreviewTime", 11, KEY_PREVIEW_TIME },
+    [34] = { "Source", 6, KEY_SOURCE },
+    [35] = { "SliderMultiplier", 16, KEY_SV },
+    [38] = { "StackLeniency", 13, KEY_STACK_LENIENCY },
+    [42] = { "BeatmapSetID", 12, KEY_BEATMAPSET_ID },
+    [50] = { "SamplesMatchPlaybackRate", 24, KEY_SAMPLES_MATCH_PLAYBACK_RATE },
+    [57] = { "SampleSet", 9, KEY_SAMPLE_SET },
+    [58] = { "BeatmapID", 9, KEY_BEATMAP_ID },
+    [61] = { "AudioLeadIn", 11, KEY_AUDIO_LEAD_IN },
+    [62] = { "SliderTickRate", 14, KEY_SLIDER_TICK_RATE },
+};
+
+osu_key_t osu_find_key(span_t name) {
+    uint32_t h = osu_hash(name, 236, 67, 164, 37, 63);
+    return (osu_key_t)lookup(KEYS, h, name, KEY_UNKNOWN);
+}
+
+uint32_t osu_hash(span_t s, uint32_t k0, uint32_t k1, uint32_t k2, uint32_t k3, uint32_t mask) {
+    if (s.size == 0)
+        return 0;
+
+    const uint8_t* p = (const uint8_t*)s.data;
+    return ((uint32_t)s.size * k0 + p[0] * k1 + p[s.size / 2] * k2 + p[s.size - 1] * k3) & mask;
+}
+
+int lookup(const osu_name_t* table, uint32_t h, span_t name, int unknown) {
+    // Empty slots have length 0, which no non-empty name matches
+    const osu_name_t* entry = &table[h];
+    if (name.size == 0 || entry->length != name.size || memcmp(entry->name, name.data, name.size) != 0)
+        return unknown;
+    return entry->value;
+}
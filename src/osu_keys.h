@@ -0,0 +1,60 @@
+/* Generated by tools/gen_osu_keys.py, do not edit. */
+#ifndef OSU_KEYS_H
+#define OSU_KEYS_H
+
+#include "lexer.h"
+
+
+/* types */
+typedef enum {
+    SECTION_NULL,  // before the first section header ("osu file format vXX")
+    SECTION_UNKNOWN,
+    SECTION_GENERAL,
+    SECTION_EDITOR,
+    SECTION_METADATA,
+    SECTION_DIFFICULTY,
+    SECTION_EVENTS,
+    SECTION_TIMING_POINTS,
+    SECTION_COLOURS,
+    SECTION_HITOBJECTS,
+} osu_section_t;
+
+typedef enum {
+    KEY_UNKNOWN,
+    KEY_AUDIO_FILENAME,
+    KEY_AUDIO_LEAD_IN,
+    KEY_PREVIEW_TIME,
+    KEY_COUNTDOWN,
+    KEY_SAMPLE_SET,
+    KEY_STACK_LENIENCY,
+    KEY_MODE,
+    KEY_LETTERBOX_IN_BREAKS,
+    KEY_SPECIAL_STYLE,
+    KEY_WIDESCREEN_STORYBOARD,
+    KEY_SAMPLES_MATCH_PLAYBACK_RATE,
+    KEY_TITLE,
+    KEY_TITLE_UNICODE,
+    KEY_ARTIST,
+    KEY_ARTIST_UNICODE,
+    KEY_CREATOR,
+    KEY_VERSION,
+    KEY_SOURCE,
+    KEY_TAGS,
+    KEY_BEATMAP_ID,
+    KEY_BEATMAPSET_ID,
+    KEY_HP,
+    KEY_CS,
+    KEY_OD,
+    KEY_AR,
+    KEY_SV,
+    KEY_SLIDER_TICK_RATE,
+} osu_key_t;
+
+
+/* function declarations */
+// Names are compared in full, anything not in the tables is SECTION_UNKNOWN/KEY_UNKNOWN
+osu_section_t   osu_find_section(span_t name);
+osu_key_t       osu_find_key(span_t name);
+
+
+#endif
@@ -0,0 +1,299 @@
+#define SCOPE_NAME "osz loader"
+#include "osz.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kvec.h>
+
+#include "util.h"
+#include "inflate.h"
+#include "mapped_file.h"
+
+
+/* constants */
+#define EOCD_SIGNATURE          0x06054b50
+#define EOCD_SIZE               22
+#define EOCD_MAX_COMMENT        0xffff
+#define CENTRAL_SIGNATURE       0x02014b50
+#define CENTRAL_HEADER_SIZE     46
+#define LOCAL_SIGNATURE         0x04034b50
+#define LOCAL_HEADER_SIZE       30
+#define FLAG_ENCRYPTED          0x0001
+#define METHOD_STORED           0
+#define METHOD_DEFLATED         8
+
+
+/* local functions */
+static error_t      read_central_directory(osz_t* archive);
+static error_t      locate_entry(osz_t* archive, osz_entry_t* entry, const char** compressed);
+static error_t      inflate_entry(osz_t* archive, osz_entry_t* entry, char* out);
+static uint16_t     read_u16(const char* p);
+static uint32_t     read_u32(const char* p);
+
+
+error_t osz_open(osz_t* archive, const char* path) {
+    assert(archive != NULL);
+    assert(path != NULL);
+
+    memset(archive, 0, sizeof(osz_t));
+    kv_init(archive->entries);
+
+    CHECK_ERROR_PROPAGATE(mapped_file_load(&archive->file, path));
+
+    error_t err = read_central_directory(archive);
+    if (err != ERROR_SUCCESS) {
+        LOGF("\"%s\" is not a valid .osz archive", path);
+        osz_close(archive);
+        return err;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+void osz_close(osz_t* archive) {
+    assert(archive != NULL);
+
+    for (int i = 0; i < kv_size(archive->entries); i++)
+        free(kv_A(archive->entries, i).data);
+    kv_destroy(archive->entries);
+    kv_init(archive->entries);
+
+    mapped_file_unload(&archive->file);
+}
+
+int osz_find_entry(osz_t* archive, const char* name) {
+    assert(archive != NULL);
+    assert(name != NULL);
+
+    for (int i = 0; i < kv_size(archive->entries); i++)
+        if (strcmp(kv_A(archive->entries, i).name, name) == 0)
+            return i;
+
+    return -1;
+}
+
+error_t osz_extract(osz_t* archive, int index, mapped_file_t* contents) {
+    assert(archive != NULL);
+    assert(contents != NULL);
+    assert(index >= 0 && index < kv_size(archive->entries));
+
+    osz_entry_t* entry = &kv_A(archive->entries, index);
+
+    memset(contents, 0, sizeof(mapped_file_t));
+    char* data = malloc(MAX(entry->size, 1));
+    if (data == NULL)
+        return ERROR_UNDEFINED;
+
+    error_t err = inflate_entry(archive, entry, data);
+    if (err != ERROR_SUCCESS) {
+        free(data);
+        return err;
+    }
+
+    contents->data = data;
+    contents->size = entry->size;
+    contents->is_mapped = false;
+    return ERROR_SUCCESS;
+}
+
+error_t osz_get_blob(osz_t* archive, int index, osz_blob_t* blob) {
+    assert(archive != NULL);
+    assert(blob != NULL);
+    assert(index >= 0 && index < kv_size(archive->entries));
+
+    osz_entry_t* entry = &kv_A(archive->entries, index);
+
+    if (entry->method == METHOD_STORED) {
+        // Nothing to inflate, point straight into the mapped archive
+        CHECK_ERROR_PROPAGATE(locate_entry(archive, entry, &blob->data));
+        blob->size = entry->size;
+        return ERROR_SUCCESS;
+    }
+
+    if (entry->data == NULL) {
+        mapped_file_t contents;
+        CHECK_ERROR_PROPAGATE(osz_extract(archive, index, &contents));
+        entry->data = (char*)contents.data;
+    }
+
+    blob->data = entry->data;
+    blob->size = entry->size;
+    return ERROR_SUCCESS;
+}
+
+error_t osz_reader_open(osz_reader_t* reader, osz_t* archive, int index) {
+    assert(reader != NULL);
+    assert(archive != NULL);
+    assert(index >= 0 && index < kv_size(archive->entries));
+
+    memset(reader, 0, sizeof(osz_reader_t));
+    reader->entry = &kv_A(archive->entries, index);
+
+    const char* compressed;
+    CHECK_ERROR_PROPAGATE(locate_entry(archive, &kv_A(archive->entries, index), &compressed));
+
+    if (reader->entry->method == METHOD_STORED) {
+        reader->data = compressed;
+        return ERROR_SUCCESS;
+    }
+
+    reader->inflater = inflate_stream_create(compressed, reader->entry->compressed_size);
+    if (reader->inflater == NULL)
+        return ERROR_UNDEFINED;
+    return ERROR_SUCCESS;
+}
+
+error_t osz_reader_read(osz_reader_t* reader, void* out, size_t size, size_t* read) {
+    assert(reader != NULL);
+    assert(reader->entry != NULL);
+    assert(read != NULL);
+
+    const osz_entry_t* entry = reader->entry;
+    size_t requested = MIN(size, entry->size - reader->pos);
+    if (reader->inflater) {
+        CHECK_ERROR_PROPAGATE(inflate_stream_read(reader->inflater, out, requested, read));
+    }
+    else {
+        memcpy(out, reader->data + reader->pos, requested);
+        *read = requested;
+    }
+    reader->crc32 = crc32_update(reader->crc32, out, *read);
+    reader->pos += *read;
+
+    // At the end, the stream must not go on past the size in the directory
+    if (*read < size) {
+        char extra;
+        size_t extra_read = 0;
+        if (reader->inflater)
+            CHECK_ERROR_PROPAGATE(inflate_stream_read(reader->inflater, &extra, 1, &extra_read));
+
+        if (reader->pos != entry->size || extra_read || reader->crc32 != entry->crc32) {
+            LOGF("\"%s\" is corrupted", entry->name);
+            return ERROR_INVALID_FORMAT;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+void osz_reader_close(osz_reader_t* reader) {
+    assert(reader != NULL);
+
+    inflate_stream_destroy(reader->inflater);
+    memset(reader, 0, sizeof(osz_reader_t));
+}
+
+error_t read_central_directory(osz_t* archive) {
+    const char* data = archive->file.data;
+    size_t size = archive->file.size;
+
+    if (size < EOCD_SIZE)
+        return ERROR_INVALID_FORMAT;
+
+    // The end of central directory record is followed by a variable length comment
+    const char* eocd = NULL;
+    size_t search_end = (size > EOCD_SIZE + EOCD_MAX_COMMENT) ? (size - EOCD_SIZE - EOCD_MAX_COMMENT) : (0);
+    for (size_t i = size - EOCD_SIZE + 1; i-- > search_end;) {
+        if (read_u32(data + i) == EOCD_SIGNATURE) {
+            eocd = data + i;
+            break;
+        }
+    }
+    if (eocd == NULL)
+        return ERROR_INVALID_FORMAT;
+
+    size_t entry_count = read_u16(eocd + 10);
+    size_t cd_size = read_u32(eocd + 12);
+    size_t cd_offset = read_u32(eocd + 16);
+    if (cd_offset > size || cd_size > size - cd_offset)
+        return ERROR_INVALID_FORMAT;  // also catches ZIP64 archives (0xffffffff)
+
+    kv_resize(osz_entry_t, archive->entries, entry_count);
+
+    const char* p = data + cd_offset;
+    const char* end = p + cd_size;
+    for (size_t i = 0; i < entry_count; i++) {
+        if ((size_t)(end - p) < CENTRAL_HEADER_SIZE || read_u32(p) != CENTRAL_SIGNATURE)
+            return ERROR_INVALID_FORMAT;
+
+        int flags           = read_u16(p + 8);
+        size_t name_length  = read_u16(p + 28);
+        size_t header_size  = CENTRAL_HEADER_SIZE + name_length + read_u16(p + 30) + read_u16(p + 32);
+        if ((size_t)(end - p) < header_size)
+            return ERROR_INVALID_FORMAT;
+
+        osz_entry_t entry = {
+            .offset             = read_u32(p + 42),
+            .compressed_size    = read_u32(p + 20),
+            .size               = read_u32(p + 24),
+            .crc32              = read_u32(p + 16),
+            .method             = read_u16(p + 10),
+        };
+        memcpy(entry.name, p + CENTRAL_HEADER_SIZE, MIN(name_length, ARRAY_LENGTH(entry.name) - 1));
+        p += header_size;
+
+        bool is_directory = name_length > 0 && entry.name[MIN(name_length, ARRAY_LENGTH(entry.name) - 1) - 1] == '/';
+        if (is_directory || (flags & FLAG_ENCRYPTED))
+            continue;
+        if (entry.method != METHOD_STORED && entry.method != METHOD_DEFLATED) {
+            LOGF("skipping \"%s\": unsupported compression method %d", entry.name, entry.method);
+            continue;
+        }
+
+        kv_push(osz_entry_t, archive->entries, entry);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+error_t locate_entry(osz_t* archive, osz_entry_t* entry, const char** compressed) {
+    const char* data = archive->file.data;
+    size_t size = archive->file.size;
+
+    if (entry->offset > size || size - entry->offset < LOCAL_HEADER_SIZE)
+        return ERROR_INVALID_FORMAT;
+
+    const char* header = data + entry->offset;
+    if (read_u32(header) != LOCAL_SIGNATURE)
+        return ERROR_INVALID_FORMAT;
+
+    // The local header may have a different extra field than the central one
+    size_t data_offset = entry->offset + LOCAL_HEADER_SIZE + read_u16(header + 26) + read_u16(header + 28);
+    if (data_offset > size || size - data_offset < entry->compressed_size)
+        return ERROR_INVALID_FORMAT;
+    if (entry->method == METHOD_STORED && entry->compressed_size != entry->size)
+        return ERROR_INVALID_FORMAT;
+
+    *compressed = data + data_offset;
+    return ERROR_SUCCESS;
+}
+
+error_t inflate_entry(osz_t* archive, osz_entry_t* entry, char* out) {
+    const char* compressed;
+    CHECK_ERROR_PROPAGATE(locate_entry(archive, entry, &compressed));
+
+    size_t written = entry->size;
+    if (entry->method == METHOD_STORED)
+        memcpy(out, compressed, entry->size);
+    else
+        CHECK_ERROR_PROPAGATE(inflate_raw(compressed, entry->compressed_size, out, entry->size, &written));
+
+    if (written != entry->size || crc32_update(0, out, written) != entry->crc32) {
+        LOGF("\"%s\" is corrupted", entry->name);
+        return ERROR_INVALID_FORMAT;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+uint16_t read_u16(const char* p) {
+    const uint8_t* b = (const uint8_t*)p;
+    return b[0] | (b[1] << 8);
+}
+
+uint32_t read_u32(const char* p) {
+    const uint8_t* b = (const uint8_t*)p;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
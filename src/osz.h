@@ -0,0 +1,66 @@
+/* References:
+ *     https://osu.ppy.sh/wiki/en/Client/File_formats/osz_(file_format)
+ *     https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+ */
+#ifndef OSZ_H
+#define OSZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kvec.h>
+
+#include "util.h"
+#include "inflate.h"
+#include "mapped_file.h"
+
+
+/* types */
+typedef struct {
+    char        name[256];
+    size_t      offset;  // of the local file header
+    size_t      compressed_size;
+    size_t      size;
+    uint32_t    crc32;
+    int         method;
+    char*       data;  // inflated contents, NULL until requested through osz_get_blob()
+} osz_entry_t;
+
+// .osz is a plain zip archive. Only the central directory is read on open,
+// entries are inflated straight from the mapped archive when they are requested.
+typedef struct {
+    mapped_file_t           file;
+    kvec_t(osz_entry_t)     entries;
+} osz_t;
+
+typedef struct {
+    const char* data;
+    size_t      size;
+} osz_blob_t;
+
+// Reads one entry a piece at a time, so only a window of it is in memory. The size
+// and CRC are checked once the end is reached.
+typedef struct {
+    const osz_entry_t*  entry;
+    const char*         data;  // stored entries are copied straight from the archive
+    inflate_stream_t*   inflater;  // deflated ones go through a window
+    size_t              pos;
+    uint32_t            crc32;
+} osz_reader_t;
+
+
+/* function declarations */
+error_t osz_open(osz_t* archive, const char* path);
+void    osz_close(osz_t* archive);
+
+int     osz_find_entry(osz_t* archive, const char* name);
+error_t osz_extract(osz_t* archive, int index, mapped_file_t* contents);  // caller owns `contents`
+error_t osz_get_blob(osz_t* archive, int index, osz_blob_t* blob);        // cached until osz_close()
+
+error_t osz_reader_open(osz_reader_t* reader, osz_t* archive, int index);
+error_t osz_reader_read(osz_reader_t* reader, void* out, size_t size, size_t* read);  // fills `out` unless the entry ends first
+void    osz_reader_close(osz_reader_t* reader);
+
+
+#endif
@@ -0,0 +1,150 @@
+#define SCOPE_NAME "paths"
+#include "paths.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+    #define strcasecmp _stricmp
+#else
+    #include <strings.h>
+#endif
+
+#include <kvec.h>
+
+#include "util.h"
+
+
+/* constants */
+#define MAX_PATH_LENGTH 1024
+#define MAX_TREE_DEPTH  16  // deeper subdirectories are skipped, also stops symlink loops
+
+
+/* local functions */
+static void list_tree(path_list_t* list, const char* directory, const char* extension, int depth);
+
+
+bool path_is_directory(const char* path) {
+    assert(path != NULL);
+
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool path_is_file(const char* path) {
+    assert(path != NULL);
+
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+uint64_t path_get_size(const char* path) {
+    assert(path != NULL);
+
+    struct stat st;
+    return (stat(path, &st) == 0) ? ((uint64_t)st.st_size) : (0);
+}
+
+bool path_has_extension(const char* path, const char* extension) {
+    assert(path != NULL);
+    assert(extension != NULL);
+
+    const char* dot = strrchr(path_get_file_name(path), '.');
+    return dot != NULL && strcasecmp(dot, extension) == 0;
+}
+
+const char* path_get_file_name(const char* path) {
+    assert(path != NULL);
+
+    const char* slash = strrchr(path, '/');
+    const char* backslash = strrchr(path, '\\');
+    if (backslash > slash)
+        slash = backslash;
+    return (slash) ? (slash + 1) : (path);
+}
+
+error_t path_list_directory(path_list_t* list, const char* directory, const char* extension) {
+    assert(list != NULL);
+    assert(directory != NULL);
+
+    kv_init(*list);
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return ERROR_FILE_NOT_FOUND;
+
+    char path[MAX_PATH_LENGTH];
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        int length = snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        if (length <= 0 || (size_t)length >= sizeof(path)) {
+            LOGF("skipping \"%s\" in \"%s\", the path is too long", entry->d_name, directory);
+            continue;
+        }
+        if (extension && (!path_has_extension(entry->d_name, extension) || !path_is_file(path)))
+            continue;
+
+        kv_push(char*, *list, strdup(path));
+    }
+    closedir(dir);
+
+    return ERROR_SUCCESS;
+}
+
+error_t path_list_tree(path_list_t* list, const char* directory, const char* extension) {
+    assert(list != NULL);
+    assert(directory != NULL);
+
+    kv_init(*list);
+    if (!path_is_directory(directory))
+        return ERROR_FILE_NOT_FOUND;
+
+    list_tree(list, directory, extension, 0);
+    return ERROR_SUCCESS;
+}
+
+void path_list_destroy(path_list_t* list) {
+    assert(list != NULL);
+
+    for (int i = 0; i < kv_size(*list); i++)
+        free(kv_A(*list, i));
+    kv_destroy(*list);
+    kv_init(*list);
+}
+
+void list_tree(path_list_t* list, const char* directory, const char* extension, int depth) {
+    path_list_t entries;
+    if (path_list_directory(&entries, directory, NULL) != ERROR_SUCCESS)
+        return;
+
+    path_list_t subdirectories;
+    kv_init(subdirectories);
+    for (int i = 0; i < kv_size(entries); i++) {
+        char* path = kv_A(entries, i);
+        if (path_is_directory(path)) {
+            kv_push(char*, subdirectories, path);
+        }
+        else if (path_is_file(path) && (!extension || path_has_extension(path, extension))) {
+            kv_push(char*, *list, path);
+        }
+        else {
+            free(path);
+        }
+    }
+    kv_destroy(entries);
+
+    for (int i = 0; i < kv_size(subdirectories); i++) {
+        if (depth < MAX_TREE_DEPTH)
+            list_tree(list, kv_A(subdirectories, i), extension, depth + 1);
+        else
+            LOGF("skipping \"%s\", it is too deep", kv_A(subdirectories, i));
+    }
+    path_list_destroy(&subdirectories);
+}
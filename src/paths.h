@@ -0,0 +1,36 @@
+#ifndef PATHS_H
+#define PATHS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kvec.h>
+
+#include "util.h"
+
+
+/* types */
+typedef kvec_t(char*) path_list_t;
+
+
+/* function declarations */
+// raylib's file helpers share static buffers (TextSplit(), TextToLower(), the file
+// name buffer) with the render thread. Loaders and the library watcher run on
+// threads of their own, so they use these instead.
+bool        path_is_directory(const char* path);
+bool        path_is_file(const char* path);  // regular files only
+uint64_t    path_get_size(const char* path);  // 0 if it does not exist
+bool        path_has_extension(const char* path, const char* extension);  // case-insensitive, with the dot
+const char* path_get_file_name(const char* path);  // points into `path`
+
+// Full paths of the entries of `directory` in readdir() order. With an extension
+// only the regular files that have it are listed, NULL lists everything.
+error_t     path_list_directory(path_list_t* list, const char* directory, const char* extension);
+// Regular files of `directory` and of all its subdirectories, parents before their
+// subdirectories. Like path_list_directory(), NULL accepts any extension.
+error_t     path_list_tree(path_list_t* list, const char* directory, const char* extension);
+void        path_list_destroy(path_list_t* list);
+
+
+#endif
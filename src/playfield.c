@@ -2,6 +2,17 @@
 #include "playfield.h"
 
 #include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define HAS_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define HAS_SSE2 1
+#endif
 
 #include <kvec.h>
 
@@ -9,59 +20,205 @@
 #include "beatmap.h"
 
 
+
+/* constants */
+#define MAX_CURSOR_STEPS    8  // a cursor that falls further behind searches instead
+
+
+/* macros */
+// Grows a kvec to exactly `s` items unless it already has room, false if out of
+// memory. The kvec keeps its buffer then, playfield_destroy() still frees it.
+#define RESERVE(type, region, v, s) \
+    ((v).m >= (size_t)(s) || reserve(region, (void**)&(v).a, &(v).m, sizeof(type), (s)))
+
+
+/* types */
+typedef float (*event_key_t)(const playfield_column_t* pc, int i);
+
+
+/* local functions */
+static bool     reserve(region_t* region, void** a, size_t* m, size_t item_size, size_t size);
+static int      find_speed_modifier(const playfield_speed_modifier_t* sms, int first, int count, ms_t time);
+static float    get_position(const playfield_speed_modifier_t* sm, ms_t time);
+static bool     build_speed_modifiers(playfield_t* playfield, difficulty_t* difficulty);
+static bool     build_column(playfield_t* playfield, playfield_column_t* pc, const hitobject_arrays_t* arrays, int column);
+static error_t  index_column(playfield_t* playfield, playfield_column_t* pc);
+static float    get_highest(const playfield_column_t* pc, int i);
+static float    get_lowest(const playfield_column_t* pc, int i);
+static void     push_event(playfield_column_t* pc, float position, playfield_event_type_t type);
+static int      seek_bound(const playfield_column_t* pc, event_key_t key, int from, float y, bool is_inclusive);
+
+
 error_t playfield_create_from(difficulty_t* difficulty, playfield_t* playfield) {
     assert(difficulty != NULL);
     assert(playfield != NULL);
 
-    kv_init(playfield->speed_mods);
+    memset(playfield, 0, sizeof(playfield_t));
+    playfield->region = difficulty->region;
+    return playfield_rebuild(playfield, difficulty);
+}
 
-    for (int i = 0; i < kv_size(difficulty->timing_points); i++) {
-        timing_point_t* tm = &kv_A(difficulty->timing_points, i);
-        
-        float position = 0;
-        if (i > 0) {
-            timing_point_t* ptm = &kv_A(difficulty->timing_points, i - 1);
-            playfield_speed_modifier_t* psm = &kv_A(playfield->speed_mods, kv_size(playfield->speed_mods) - 1);
-            position = psm->position + (tm->time - ptm->time) * 100 * ptm->SV / (60.0f / ptm->BPM);
-        }
+error_t playfield_rebuild(playfield_t* playfield, difficulty_t* difficulty) {
+    assert(playfield != NULL);
+    assert(difficulty != NULL);
 
-        playfield_speed_modifier_t sm = {
-            .speed = 100 * tm->SV / (60.0f / tm->BPM),
-            .position = position,
-        };
-        kv_push(playfield_speed_modifier_t, playfield->speed_mods, sm);
+    // Difficulties put together by hand may not have been partitioned yet
+    hitobject_arrays_t* arrays = &difficulty->hitobject_arrays;
+    if (arrays->count != kv_size(difficulty->hitobjects))
+        CHECK_ERROR_PROPAGATE(difficulty_build_hitobject_arrays(difficulty));
+
+    // Memory of another beatmap's region goes away with that beatmap, which is
+    // usually destroyed already. Only heap memory is freed.
+    if (playfield->region != difficulty->region) {
+        if (playfield->region == NULL)
+            playfield_destroy(playfield);
+        else
+            memset(playfield, 0, sizeof(playfield_t));
+        playfield->region = difficulty->region;
     }
+    playfield_reset(playfield);
 
-    kv_init(playfield->columns);
-    kv_resize(playfield_column_t, playfield->columns, (int)difficulty->CS);
-    kv_size(playfield->columns) = (int)difficulty->CS;
-    for (int i = 0; i < kv_size(playfield->columns); i++)
-        kv_init(kv_A(playfield->columns, i).events);
-    for (int i = 0; i < kv_size(difficulty->hitobjects); i++) {
-        hitobject_t* ho = &kv_A(difficulty->hitobjects, i);
+    int column_count = MAX((int)difficulty->CS, arrays->column_count);
+    size_t column_capacity = kv_max(playfield->columns);
+    bool is_built = RESERVE(playfield_column_t, playfield->region, playfield->columns, column_count);
+    if (is_built) {
+        for (size_t i = column_capacity; i < kv_max(playfield->columns); i++)
+            memset(&kv_A(playfield->columns, i), 0, sizeof(playfield_column_t));
+        kv_size(playfield->columns) = column_count;
+    }
 
-        playfield_event_t pe = {
-            .position = ho->start_time,
-        };
+    is_built = is_built && build_speed_modifiers(playfield, difficulty);
+    for (int i = 0; i < MIN(column_count, arrays->column_count) && is_built; i++)
+        is_built = build_column(playfield, &kv_A(playfield->columns, i), arrays, i);
 
-        if (ho->end_time) {
-            pe.type = PLAYFIELD_EVENT_HOLD_BEGIN;
-            kv_push(playfield_event_t, kv_A(playfield->columns, ho->column).events, pe);
-            pe.type = PLAYFIELD_EVENT_HOLD_END;
-            pe.position = ho->end_time;
-            kv_push(playfield_event_t, kv_A(playfield->columns, ho->column).events, pe);
-        }
-        else {
-            pe.type = PLAYFIELD_EVENT_NOTE;
-            kv_push(playfield_event_t, kv_A(playfield->columns, ho->column).events, pe);
-        }
+    if (!is_built) {
+        LOGF("out of memory while creating the playfield of \"%s\"", difficulty->name);
+        playfield_destroy(playfield);
+        return ERROR_UNDEFINED;
     }
 
     LOGF_SUCCESS("Created playfield from \"%s\"", difficulty->name);
     return ERROR_SUCCESS;
 }
 
+void playfield_reset(playfield_t* playfield) {
+    assert(playfield != NULL);
+
+    for (size_t i = 0; i < kv_max(playfield->columns); i++) {
+        playfield_column_t* pc = &kv_A(playfield->columns, i);
+        kv_size(pc->positions) = 0;
+        kv_size(pc->types) = 0;
+        kv_size(pc->highest) = 0;
+        kv_size(pc->lowest) = 0;
+    }
+    kv_size(playfield->columns) = 0;
+    kv_size(playfield->speed_mods) = 0;
+}
+
+float playfield_get_position(playfield_t* playfield, ms_t time) {
+    assert(playfield != NULL);
+
+    int count = kv_size(playfield->speed_mods);
+    if (count == 0)
+        return 0;
+
+    return get_position(&kv_A(playfield->speed_mods, find_speed_modifier(playfield->speed_mods.a, 0, count, time)), time);
+}
+
+float playfield_seek_position(playfield_t* playfield, playfield_cursor_t* cursor, ms_t time) {
+    assert(playfield != NULL);
+    assert(cursor != NULL);
+
+    const playfield_speed_modifier_t* sms = playfield->speed_mods.a;
+    int count = kv_size(playfield->speed_mods);
+    if (count == 0)
+        return 0;
+
+    int i = MAX(MIN(cursor->index, count - 1), 0);
+    if (sms[i].time > time) {
+        // Seeking back, start over
+        i = find_speed_modifier(sms, 0, i, time);
+    }
+    else {
+        // Playback usually stays in the same segment or moves to the next one
+        int steps = 0;
+        while (i + 1 < count && sms[i + 1].time <= time && steps++ < MAX_CURSOR_STEPS)
+            i++;
+        if (i + 1 < count && sms[i + 1].time <= time)
+            i = find_speed_modifier(sms, i, count, time);
+    }
+
+    cursor->index = i;
+    return get_position(&sms[i], time);
+}
+
+void playfield_query_window(playfield_t* playfield, int column, playfield_window_t* window, float y0, float y1) {
+    assert(playfield != NULL);
+    assert(window != NULL);
+    assert(column >= 0 && column < kv_size(playfield->columns));
+
+    const playfield_column_t* pc = &kv_A(playfield->columns, column);
+    int count = kv_size(pc->positions);
+
+    int first = seek_bound(pc, get_highest, window->first, y0, true);
+    int last = seek_bound(pc, get_lowest, MAX(window->last, first), y1, false);
+
+    // A hold longer than the window has both ends outside of it
+    if (first < count && playfield_get_event_type(pc, first) == PLAYFIELD_EVENT_HOLD_END)
+        first--;
+    if (last > 0 && last < count && playfield_get_event_type(pc, last - 1) == PLAYFIELD_EVENT_HOLD_BEGIN)
+        last++;
+
+    window->first = first;
+    window->last = MAX(last, first);
+}
+
+void playfield_project_events(const float* positions, int count, float scroll, float scale, float origin, float* ys) {
+    assert(positions != NULL || count == 0);
+    assert(ys != NULL || count == 0);
+
+    int i = 0;
+
+    // Same operations in the same order as the scalar loop below, which also handles the tail
+#if defined(HAS_AVX2)
+    __m256 scroll_8 = _mm256_set1_ps(scroll);
+    __m256 scale_8 = _mm256_set1_ps(scale);
+    __m256 origin_8 = _mm256_set1_ps(origin);
+    for (; count - i >= 8; i += 8) {
+        __m256 p = _mm256_loadu_ps(positions + i);
+        __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(p, scroll_8), scale_8), origin_8);
+        _mm256_storeu_ps(ys + i, y);
+    }
+#endif
+#if defined(HAS_SSE2)
+    __m128 scroll_4 = _mm_set1_ps(scroll);
+    __m128 scale_4 = _mm_set1_ps(scale);
+    __m128 origin_4 = _mm_set1_ps(origin);
+    for (; count - i >= 4; i += 4) {
+        __m128 p = _mm_loadu_ps(positions + i);
+        __m128 y = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(p, scroll_4), scale_4), origin_4);
+        _mm_storeu_ps(ys + i, y);
+    }
+#endif
+
+    for (; i < count; i++)
+        ys[i] = (positions[i] - scroll) * scale + origin;
+}
+
 void playfield_destroy(playfield_t* playfield) {
+    assert(playfield != NULL);
+
+    // Freed memory stays in the region and is reused by the next playfield
+    for (size_t i = 0; i < kv_max(playfield->columns); i++) {
+        playfield_column_t* pc = &kv_A(playfield->columns, i);
+        region_kv_destroy(playfield->region, pc->positions);
+        region_kv_destroy(playfield->region, pc->types);
+        region_kv_destroy(playfield->region, pc->highest);
+        region_kv_destroy(playfield->region, pc->lowest);
+    }
+    region_kv_destroy(playfield->region, playfield->columns);
+    region_kv_destroy(playfield->region, playfield->speed_mods);
+    memset(playfield, 0, sizeof(playfield_t));
 }
 
 void playfield_debug_print(playfield_t* playfield) {
@@ -72,20 +229,188 @@ void playfield_debug_print(playfield_t* playfield) {
     LOG("Playfield info:");
     int c = 0;
     for (int i = 0; i < kv_size(playfield->columns); i++)
-        c += kv_size(kv_A(playfield->columns, i).events);
+        c += kv_size(kv_A(playfield->columns, i).positions);
     LOGF_DESC("events[%d]:", c);
     for (int i = 0; i < kv_size(playfield->columns); i++) {
         playfield_column_t* pc = &kv_A(playfield->columns, i);
 
-        for (int j = 0; j < kv_size(pc->events); j++) {
-            playfield_event_t* pe = &kv_A(pc->events, j);
-            LOGF_DESC("\tEV[%d]: %s at %8f", j, event_names[pe->type], pe->position);
+        for (int j = 0; j < kv_size(pc->positions); j++) {
+            playfield_event_t pe = playfield_get_event(pc, j);
+            LOGF_DESC("\tEV[%d]: %s at %8f", j, event_names[pe.type], pe.position);
         }
     }
 
     LOGF_DESC("spd mods[%lu]:", kv_size(playfield->speed_mods));
     for (int i = 0; i < kv_size(playfield->speed_mods); i++) {
         playfield_speed_modifier_t* sm = &kv_A(playfield->speed_mods, i);
-        LOGF_DESC("\tSM[%d]: %8.f at %8.f", i, sm->speed, sm->position);
+        LOGF_DESC("\tSM[%d]: %8.f at %8.f (%d ms)", i, sm->speed, sm->position, sm->time);
+    }
+}
+
+bool reserve(region_t* region, void** a, size_t* m, size_t item_size, size_t size) {
+    void* grown = region_realloc(region, *a, item_size * size);
+    if (grown == NULL)
+        return false;
+
+    *a = grown;
+    *m = size;
+    return true;
+}
+
+int find_speed_modifier(const playfield_speed_modifier_t* sms, int first, int count, ms_t time) {
+    // Last modifier at or before `time` in [first, count), the first one for earlier times
+    int lo = first, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sms[mid].time <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return MAX(lo - 1, first);
+}
+
+float get_position(const playfield_speed_modifier_t* sm, ms_t time) {
+    return sm->position + ((double)time - sm->time) / 1000.0 * sm->speed;
+}
+
+bool build_speed_modifiers(playfield_t* playfield, difficulty_t* difficulty) {
+    if (!RESERVE(playfield_speed_modifier_t, playfield->region, playfield->speed_mods, kv_size(difficulty->timing_points)))
+        return false;
+
+    // Summed in double, adding thousands of float segments drifts visibly on long maps
+    double position = 0;
+    for (int i = 0; i < kv_size(difficulty->timing_points); i++) {
+        timing_point_t* tm = &kv_A(difficulty->timing_points, i);
+
+        // The first timing point may be before or after song time 0, its speed applies back to 0
+        if (i == 0) {
+            float speed = 100 * tm->SV / (60.0f / tm->BPM);
+            position = (isfinite(speed)) ? (tm->time / 1000.0 * speed) : (0);
+        }
+        else {
+            playfield_speed_modifier_t* psm = &kv_A(playfield->speed_mods, i - 1);
+            position += ((double)tm->time - psm->time) / 1000.0 * psm->speed;
+        }
+
+        playfield_speed_modifier_t sm = {
+            .time = tm->time,
+            .speed = 100 * tm->SV / (60.0f / tm->BPM),
+            .position = (float)position,
+        };
+        if (!isfinite(sm.speed))
+            sm.speed = 0;  // zero beat length, would turn every position after it into NaN
+        kv_A(playfield->speed_mods, kv_size(playfield->speed_mods)++) = sm;
+    }
+    return true;
+}
+
+bool build_column(playfield_t* playfield, playfield_column_t* pc, const hitobject_arrays_t* arrays, int column) {
+    // The loader already grouped the objects by column, so each column is sized once
+    const uint32_t* first = arrays->by_column + arrays->column_offsets[column];
+    const uint32_t* last = arrays->by_column + arrays->column_offsets[column + 1];
+    size_t event_count = 0;
+    for (const uint32_t* j = first; j < last; j++)
+        event_count += (arrays->end[*j]) ? (2) : (1);
+    if (event_count == 0)
+        return true;
+
+    size_t type_count = (event_count + 3) / 4;
+    if (!RESERVE(float, playfield->region, pc->positions, event_count)
+        || !RESERVE(uint8_t, playfield->region, pc->types, type_count))
+        return false;
+    kv_size(pc->types) = type_count;
+    memset(pc->types.a, 0, type_count);
+
+    // Each column is in time order, hold ends get their own cursor
+    playfield_cursor_t cursor = {0};
+    playfield_cursor_t end_cursor = {0};
+    for (const uint32_t* j = first; j < last; j++) {
+        float position = playfield_seek_position(playfield, &cursor, arrays->start[*j]);
+
+        if (arrays->end[*j]) {
+            push_event(pc, position, PLAYFIELD_EVENT_HOLD_BEGIN);
+            push_event(pc, playfield_seek_position(playfield, &end_cursor, arrays->end[*j]), PLAYFIELD_EVENT_HOLD_END);
+        }
+        else {
+            push_event(pc, position, PLAYFIELD_EVENT_NOTE);
+        }
     }
+
+    return index_column(playfield, pc) == ERROR_SUCCESS;
+}
+
+error_t index_column(playfield_t* playfield, playfield_column_t* pc) {
+    const float* positions = pc->positions.a;
+    int count = kv_size(pc->positions);
+
+    bool is_sorted = true;
+    for (int i = 1; i < count && is_sorted; i++)
+        is_sorted = positions[i - 1] <= positions[i];
+    if (is_sorted)
+        return ERROR_SUCCESS;
+
+    // Running extremes are sorted, so the window can still be searched for
+    if (!RESERVE(float, playfield->region, pc->highest, count) || !RESERVE(float, playfield->region, pc->lowest, count))
+        return ERROR_UNDEFINED;
+    kv_size(pc->highest) = count;
+    kv_size(pc->lowest) = count;
+
+    float* highest = pc->highest.a;
+    float* lowest = pc->lowest.a;
+    highest[0] = positions[0];
+    for (int i = 1; i < count; i++)
+        highest[i] = MAX(highest[i - 1], positions[i]);
+    lowest[count - 1] = positions[count - 1];
+    for (int i = count - 2; i >= 0; i--)
+        lowest[i] = MIN(lowest[i + 1], positions[i]);
+    return ERROR_SUCCESS;
+}
+
+void push_event(playfield_column_t* pc, float position, playfield_event_type_t type) {
+    // Sized by the caller, `types` starts zeroed
+    int i = kv_size(pc->positions)++;
+    kv_A(pc->positions, i) = position;
+    pc->types.a[i >> 2] |= (uint8_t)(type << ((i & 3) * 2));
+}
+
+float get_highest(const playfield_column_t* pc, int i) {
+    return (kv_size(pc->highest)) ? (pc->highest.a[i]) : (pc->positions.a[i]);
+}
+
+float get_lowest(const playfield_column_t* pc, int i) {
+    return (kv_size(pc->lowest)) ? (pc->lowest.a[i]) : (pc->positions.a[i]);
+}
+
+int seek_bound(const playfield_column_t* pc, event_key_t key, int from, float y, bool is_inclusive) {
+    // First event whose key is not below `y`, or above it when not `is_inclusive`
+    #define IS_BEFORE(i) ((is_inclusive) ? (key(pc, i) < y) : (key(pc, i) <= y))
+
+    int count = kv_size(pc->positions);
+    int lo = 0, hi = count;
+    int i = MAX(MIN(from, count), 0);
+
+    // Frame to frame the window moves by a few events, scrolling back or jumping searches
+    if (i > 0 && !IS_BEFORE(i - 1)) {
+        hi = i - 1;
+    }
+    else {
+        int steps = 0;
+        while (i < count && IS_BEFORE(i) && steps++ < MAX_CURSOR_STEPS)
+            i++;
+        if (i == count || !IS_BEFORE(i))
+            return i;
+        lo = i + 1;
+    }
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (IS_BEFORE(mid))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+
+    #undef IS_BEFORE
 }
@@ -1,6 +1,7 @@
 #ifndef PLAYFIELD_H
 #define PLAYFIELD_H
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #include <kvec.h>
@@ -18,30 +19,87 @@ typedef enum {
     PLAYFIELD_EVENT_HOLD_END,
 } playfield_event_type_t;
 
+// One event unpacked, columns store them as separate positions and types
 typedef struct {
-    float                   position;  // Y coordinate
+    float                   position;  // scroll position, see playfield_get_position()
     playfield_event_type_t  type;
 } playfield_event_t;
 
+// One per timing point. Between two of them the playfield scrolls at a constant
+// speed, which may be zero or negative.
 typedef struct {
-    float position;
-    float speed;  // opx
+    ms_t  time;
+    float position;  // scroll position at `time`
+    float speed;  // opx per second
 } playfield_speed_modifier_t;
 
+// Remembers the last speed modifier used so playback only steps forward
 typedef struct {
-    kvec_t(playfield_event_t) events;
+    int index;  // zero-initialize to start
+} playfield_cursor_t;
+
+// Events in time order, a HOLD_END right after its HOLD_BEGIN. Positions are
+// contiguous so scans and projection only touch them, types take 2 bits each.
+typedef struct {
+    kvec_t(float)   positions;
+    kvec_t(uint8_t) types;  // four per byte, read with playfield_get_event_type()
+
+    // Only when negative SV or overlapping holds make positions go back, empty otherwise.
+    // The highest position up to each event and the lowest from each event on.
+    kvec_t(float)   highest;
+    kvec_t(float)   lowest;
 } playfield_column_t;
 
+// Events of a column that may be visible, first up to, not including, last.
+// Zero-initialize and keep one per column, each query starts where the last ended.
+typedef struct {
+    int first;
+    int last;
+} playfield_window_t;
+
+// Every buffer keeps its memory until playfield_destroy(), columns past
+// kv_size(columns) up to kv_max(columns) are empty but may hold some too.
 typedef struct {
     kvec_t(playfield_column_t)          columns;
     kvec_t(playfield_speed_modifier_t)  speed_mods;
+    region_t*                           region;  // the difficulty's, NULL for the heap
 } playfield_t;
 
 
+/* macros */
+static inline playfield_event_type_t playfield_get_event_type(const playfield_column_t* pc, int i) {
+    return (playfield_event_type_t)((pc->types.a[i >> 2] >> ((i & 3) * 2)) & 3);
+}
+
+static inline playfield_event_t playfield_get_event(const playfield_column_t* pc, int i) {
+    playfield_event_t event = { kv_A(pc->positions, i), playfield_get_event_type(pc, i) };
+    return event;
+}
+
+
 /* function declarations */
 error_t playfield_create_from(difficulty_t* difficulty, playfield_t* playfield);
-void    playfield_destroy(playfield_t* playfield);
+void    playfield_destroy(playfield_t* playfield);  // must run before the beatmap is destroyed
+// For retries and switching difficulties. Rebuilding reuses every buffer of the
+// playfield and only grows the ones that are too small, to the exact size needed.
+error_t playfield_rebuild(playfield_t* playfield, difficulty_t* difficulty);
+void    playfield_reset(playfield_t* playfield);  // empties the playfield, keeping its memory
 void    playfield_debug_print(playfield_t* playfield);
 
+// Scroll position of `time` in opx. Song time 0 is position 0, times before the
+// first timing point scroll at its speed.
+float   playfield_get_position(playfield_t* playfield, ms_t time);
+float   playfield_seek_position(playfield_t* playfield, playfield_cursor_t* cursor, ms_t time);
+
+// Finds the events of `column` between scroll positions `y0` and `y1`, including
+// both ends of every hold that crosses the window. Positions of the events in
+// between can still be outside when the column has `highest`/`lowest`.
+void    playfield_query_window(playfield_t* playfield, int column, playfield_window_t* window, float y0, float y1);
+
+// Screen coordinates of `count` event positions, origin + (position - scroll) * scale,
+// for example with `scroll` from playfield_seek_position() and a negative `scale`
+// for downscroll. Vectorized, `ys` must have room for `count` floats.
+void    playfield_project_events(const float* positions, int count, float scroll, float scale, float origin, float* ys);
+
 
 #endif
@@ -0,0 +1,93 @@
+#define SCOPE_NAME "region"
+#include "region.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <kalloc.h>
+
+#include "util.h"
+
+
+region_t* region_create(void) {
+    region_t* region = malloc(sizeof(region_t));
+    if (region == NULL)
+        return NULL;
+
+    region->km = km_init();
+    if (region->km == NULL) {
+        free(region);
+        return NULL;
+    }
+
+    pthread_mutex_init(&region->lock, NULL);
+    return region;
+}
+
+void region_destroy(region_t* region) {
+    if (region == NULL)
+        return;
+
+    km_destroy(region->km);
+    pthread_mutex_destroy(&region->lock);
+    free(region);
+}
+
+void* region_alloc(region_t* region, size_t size) {
+    if (region == NULL)
+        return malloc(size);
+
+    pthread_mutex_lock(&region->lock);
+    void* ptr = kmalloc(region->km, size);
+    pthread_mutex_unlock(&region->lock);
+    return ptr;
+}
+
+void* region_calloc(region_t* region, size_t count, size_t size) {
+    if (region == NULL)
+        return calloc(count, size);
+
+    pthread_mutex_lock(&region->lock);
+    void* ptr = kcalloc(region->km, count, size);
+    pthread_mutex_unlock(&region->lock);
+    return ptr;
+}
+
+void* region_realloc(region_t* region, void* ptr, size_t size) {
+    if (region == NULL)
+        return realloc(ptr, size);
+
+    pthread_mutex_lock(&region->lock);
+    ptr = krealloc(region->km, ptr, size);
+    pthread_mutex_unlock(&region->lock);
+    return ptr;
+}
+
+void region_free(region_t* region, void* ptr) {
+    if (region == NULL) {
+        free(ptr);
+        return;
+    }
+
+    pthread_mutex_lock(&region->lock);
+    kfree(region->km, ptr);
+    pthread_mutex_unlock(&region->lock);
+}
+
+bool region_kv_grow(region_t* region, void** a, size_t* m, size_t item_size) {
+    assert(a != NULL);
+    assert(m != NULL);
+
+    size_t capacity = (*m) ? (*m << 1) : (2);
+    if (capacity <= *m || capacity > SIZE_MAX / item_size)
+        return false;
+
+    void* grown = region_realloc(region, *a, item_size * capacity);
+    if (grown == NULL)
+        return false;
+
+    *a = grown;
+    *m = capacity;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "util.h"
+
+
+/* types */
+// Region allocator built on klib's kalloc. Everything allocated from a region is
+// released at once by region_destroy(), no matter how it was reallocated or freed
+// before. Calls are serialized, so parse workers can share one region.
+typedef struct {
+    void*           km;
+    pthread_mutex_t lock;
+} region_t;
+
+
+/* macros */
+// kvec operations on a region, a NULL region uses the heap like plain kvec.
+// region_kv_push() is false if out of memory, `v` is left as it was then.
+#define region_kv_push(type, region, v, x)                                                  \
+    (((v).n < (v).m || region_kv_grow(region, (void**)&(v).a, &(v).m, sizeof(type)))       \
+        && ((v).a[(v).n++] = (x), true))
+#define region_kv_resize(type, region, v, s) \
+    ((v).m = (s), (v).a = (type*)region_realloc(region, (v).a, sizeof(type) * (v).m))
+#define region_kv_destroy(region, v) region_free(region, (v).a)
+
+
+/* function declarations */
+region_t*   region_create(void);
+void        region_destroy(region_t* region);  // NULL is ignored
+
+void*       region_alloc(region_t* region, size_t size);
+void*       region_calloc(region_t* region, size_t count, size_t size);
+void*       region_realloc(region_t* region, void* ptr, size_t size);
+void        region_free(region_t* region, void* ptr);  // makes the memory reusable within the region
+
+bool        region_kv_grow(region_t* region, void** a, size_t* m, size_t item_size);  // doubles the capacity, used by region_kv_push()
+
+
+#endif
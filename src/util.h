@@ -23,12 +23,17 @@ typedef enum {
     ERROR_UNDEFINED,
     /* IO */
     ERROR_FILE_NOT_FOUND,
+    ERROR_INVALID_FORMAT,
+    /* Tasks */
+    ERROR_CANCELLED,
 } error_t;
 
 static const char* ERROR_MESSAGES[] = {
     [ERROR_SUCCESS]         = "OK",
     [ERROR_UNDEFINED]       = "Undefined error",  // used when `error_t err` is out of bounds of ERROR_MESSAGES
     [ERROR_FILE_NOT_FOUND]  = "File not found",
+    [ERROR_INVALID_FORMAT]  = "Invalid file format",
+    [ERROR_CANCELLED]       = "Cancelled",
 };
 
 inline static const char* error_get_message(error_t err) {
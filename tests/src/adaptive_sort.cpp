@@ -0,0 +1,82 @@
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+extern "C" {
+#include "adaptive_sort.h"
+}
+
+
+struct item_t {
+    uint32_t key;
+    int      order;  // position before sorting, to check stability
+};
+
+static uint32_t item_key(const item_t* item) {
+    return item->key;
+}
+
+ADAPTIVE_SORT_INIT(items, item_t, item_key)
+
+static std::vector<item_t> make_items(const std::vector<uint32_t>& keys) {
+    std::vector<item_t> items;
+    for (size_t i = 0; i < keys.size(); i++)
+        items.push_back({ keys[i], (int)i });
+    return items;
+}
+
+static bool is_stably_sorted(const std::vector<item_t>& items) {
+    std::vector<item_t> expected = items;
+    std::sort(expected.begin(), expected.end(), [](const item_t& a, const item_t& b) { return a.order < b.order; });
+    std::stable_sort(expected.begin(), expected.end(), [](const item_t& a, const item_t& b) { return a.key < b.key; });
+
+    for (size_t i = 0; i < items.size(); i++)
+        if (items[i].key != expected[i].key || items[i].order != expected[i].order)
+            return false;
+    return true;
+}
+
+TEST_CASE("Adaptive sort") {
+    std::mt19937 rng(42);
+    std::vector<uint32_t> keys;
+
+    SECTION("sorted with chords") {
+        for (int i = 0; i < 10000; i++)
+            keys.push_back(i / 3 * 125);
+    }
+    SECTION("nearly sorted") {
+        for (int i = 0; i < 10000; i++)
+            keys.push_back(i * 10);
+        for (int i = 0; i < 50; i++)
+            std::swap(keys[rng() % keys.size()], keys[rng() % keys.size()]);
+    }
+    SECTION("reversed") {
+        for (int i = 0; i < 10000; i++)
+            keys.push_back(10000 - i);
+    }
+    SECTION("random with duplicates") {
+        for (int i = 0; i < 100000; i++)
+            keys.push_back(rng() % 5000 + (rng() % 2) * 0x01000000u);
+    }
+    SECTION("full range") {
+        for (int i = 0; i < 10000; i++)
+            keys.push_back(rng());
+    }
+    SECTION("tiny") {
+        keys = { 3, 1 };
+    }
+
+    std::vector<item_t> items = make_items(keys);
+    REQUIRE(adaptive_sort_items(items.data(), items.size()));
+    REQUIRE(is_stably_sorted(items));
+}
+
+TEST_CASE("Adaptive sort integer keys") {
+    std::vector<int32_t> values = { INT32_MIN, -1000, -1, 0, 1, 26597, INT32_MAX };
+    for (size_t i = 1; i < values.size(); i++)
+        REQUIRE(adaptive_sort_int_key(values[i - 1]) < adaptive_sort_int_key(values[i]));
+}
@@ -0,0 +1,143 @@
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static std::filesystem::path write_set(const char* name, int difficulty_count) {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / name;
+    fs::remove_all(root);
+    fs::create_directories(root);
+
+    for (int i = 0; i < difficulty_count; i++) {
+        std::ofstream(root / ("d" + std::to_string(i) + ".osu"), std::ios::binary)
+            << "osu file format v14\n\n[General]\nMode: 3\n\n"
+            << "[Metadata]\nTitle:Async\nVersion:" << i << "\nBeatmapID:" << i + 1 << "\nBeatmapSetID:7\n\n"
+            << "[Difficulty]\nCircleSize:4\n\n"
+            << "[TimingPoints]\n0,500,4,2,1,40,1,0\n\n"
+            << "[HitObjects]\n64,192,1000,1,0,0:0:0:0:\n";
+    }
+    return root;
+}
+
+TEST_CASE("Asynchronous beatmap loading") {
+    const std::filesystem::path root = write_set("cmania_async_load", 8);
+
+    beatmap_load_task_t* task = beatmap_load_async(root.string().c_str(), true);
+    REQUIRE(task != NULL);
+
+    beatmap_load_progress_t progress;
+    bool is_monotonic = true;
+    size_t bytes_read = 0;
+    while (beatmap_load_task_poll(task, &progress) == BEATMAP_LOAD_RUNNING) {
+        is_monotonic = is_monotonic && progress.bytes_read >= bytes_read;
+        bytes_read = progress.bytes_read;
+    }
+    REQUIRE(is_monotonic);
+
+    REQUIRE(beatmap_load_task_poll(task, &progress) == BEATMAP_LOAD_DONE);
+    REQUIRE(progress.difficulty_count == 8);
+    REQUIRE(progress.difficulties_parsed == 8);
+    REQUIRE(progress.bytes_total > 0);
+    REQUIRE(progress.bytes_read == progress.bytes_total);
+
+    beatmap_t beatmap;
+    REQUIRE(beatmap_load_task_finish(task, &beatmap) == ERROR_SUCCESS);
+    REQUIRE(kv_size(beatmap.difficulties) == 8);
+    REQUIRE(beatmap.id == 7);
+    beatmap_destroy(&beatmap);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Loading while the main thread uses raylib's file helpers") {
+    const std::filesystem::path root = write_set("cmania_async_helpers", 32);
+    const std::string path = root.string();
+
+    beatmap_load_task_t* task = beatmap_load_async(path.c_str(), false);
+    REQUIRE(task != NULL);
+
+    // What a render loop does between polls, with the static buffers the loader must not touch
+    bool is_right = true;
+    int iterations = 0;
+    while (beatmap_load_task_poll(task, NULL) == BEATMAP_LOAD_RUNNING || iterations < 100) {
+        is_right = is_right
+            && !IsFileExtension("audio.mp3", ".osu;.osz")
+            && IsFileExtension("Set.OSZ", ".osu;.osz")
+            && std::string(GetFileName("Songs/Set/easy.osu")) == "easy.osu";
+        FilePathList fs = LoadDirectoryFilesEx(path.c_str(), ".osu", false);
+        is_right = is_right && fs.count == 32;
+        UnloadDirectoryFiles(fs);
+        iterations++;
+    }
+    REQUIRE(is_right);
+
+    beatmap_t beatmap;
+    REQUIRE(beatmap_load_task_finish(task, &beatmap) == ERROR_SUCCESS);
+    REQUIRE(kv_size(beatmap.difficulties) == 32);
+    bool is_complete = true;
+    for (int i = 0; i < 32; i++)
+        is_complete = is_complete && kv_A(beatmap.difficulties, i).hitobject_arrays.count == 1;
+    REQUIRE(is_complete);
+    beatmap_destroy(&beatmap);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Loading difficulties from subfolders") {
+    namespace fs = std::filesystem;
+    const fs::path root = write_set("cmania_subfolders", 4);
+    fs::create_directories(root / "extra" / "deeper");
+    fs::rename(root / "d1.osu", root / "extra" / "d1.osu");
+    fs::rename(root / "d2.osu", root / "extra" / "deeper" / "d2.osu");
+    std::ofstream(root / "extra" / "notes.txt") << "not a difficulty\n";
+
+    beatmap_t beatmap;
+    REQUIRE(beatmap_load(&beatmap, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(beatmap.difficulties) == 4);
+    for (int i = 0; i < 4; i++) {
+        const difficulty_t* d = &kv_A(beatmap.difficulties, i);
+        REQUIRE(std::string(d->file_name) == "d" + std::to_string(i) + ".osu");
+        REQUIRE(fs::exists(d->path));
+        REQUIRE(d->hitobject_arrays.count == 1);
+    }
+    REQUIRE(fs::path(kv_A(beatmap.difficulties, 2).path) == root / "extra" / "deeper" / "d2.osu");
+    beatmap_destroy(&beatmap);
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("Cancelled beatmap loading") {
+    const std::filesystem::path root = write_set("cmania_async_cancel", 64);
+
+    beatmap_load_task_t* task = beatmap_load_async(root.string().c_str(), true);
+    REQUIRE(task != NULL);
+    beatmap_load_task_cancel(task);
+
+    // The load may finish before it sees the request
+    beatmap_t beatmap;
+    error_t err = beatmap_load_task_finish(task, &beatmap);
+    REQUIRE((err == ERROR_SUCCESS || err == ERROR_CANCELLED));
+    if (err == ERROR_CANCELLED) {
+        REQUIRE(kv_size(beatmap.difficulties) == 0);
+        REQUIRE(beatmap.region == NULL);
+    }
+    beatmap_destroy(&beatmap);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Failed asynchronous beatmap loading") {
+    beatmap_load_task_t* task = beatmap_load_async("/nonexistent/cmania", true);
+    REQUIRE(task != NULL);
+    while (beatmap_load_task_poll(task, NULL) == BEATMAP_LOAD_RUNNING)
+        ;
+    REQUIRE(beatmap_load_task_poll(task, NULL) == BEATMAP_LOAD_FAILED);
+
+    beatmap_t beatmap;
+    REQUIRE(beatmap_load_task_finish(task, &beatmap) == ERROR_FILE_NOT_FOUND);
+}
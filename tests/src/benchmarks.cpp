@@ -0,0 +1,260 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#if defined(_WIN32)
+    #include <io.h>
+    #define dup _dup
+    #define dup2 _dup2
+    #define close _close
+    #define fileno _fileno
+    #define setenv(name, value, overwrite) _putenv_s(name, value)
+    #define NULL_DEVICE "NUL"
+#else
+    #include <unistd.h>
+    #define NULL_DEVICE "/dev/null"
+#endif
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "cmania.hpp"
+#include "synthetic_map.hpp"
+
+
+// Run with `make benchmark`, ideally on a Release build
+namespace fs = std::filesystem;
+
+// The loader logs every file it touches, which would dominate short measurements
+struct quiet_stdout {
+    int saved;
+
+    quiet_stdout() {
+        std::fflush(stdout);
+        saved = dup(fileno(stdout));
+        FILE* null = std::fopen(NULL_DEVICE, "w");
+        dup2(fileno(null), fileno(stdout));
+        std::fclose(null);
+    }
+    ~quiet_stdout() {
+        std::fflush(stdout);
+        dup2(saved, fileno(stdout));
+        close(saved);
+    }
+};
+
+static void disable_cache() {
+    cache_set_enabled(false);
+}
+
+static void use_cache() {
+    static const std::string dir = (fs::temp_directory_path() / "cmania_bench_cache").string();
+    setenv("CMANIA_CACHE_DIR", dir.c_str(), 1);
+    cache_set_enabled(true);
+}
+
+static std::vector<fs::path> list_asset_maps() {
+    std::vector<fs::path> maps;
+    for (const fs::directory_entry& entry : fs::directory_iterator(ASSETS_DIR))
+        if (entry.is_directory() || entry.path().extension() == ".osz")
+            maps.push_back(entry.path());
+    std::sort(maps.begin(), maps.end());
+    return maps;
+}
+
+// Scales the real maps up: 7K, an inherited point between every pair of timing
+// points and every fourth object a hold
+static fs::path write_scaled_set(const char* name, int hitobject_count, int timing_point_count) {
+    synthetic_map_t map;
+    map.note_count = hitobject_count;
+    map.uninherited_count = timing_point_count / 2;
+    map.inherited_count = timing_point_count - map.uninherited_count;
+    return write_synthetic_set(name, map);
+}
+
+static uintmax_t get_osu_size(const fs::path& dir) {
+    if (!fs::is_directory(dir))
+        return fs::file_size(dir);  // .osz, compressed
+
+    uintmax_t size = 0;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(dir))
+        if (entry.path().extension() == ".osu")
+            size += entry.file_size();
+    return size;
+}
+
+static difficulty_t* find_largest_difficulty(beatmap_t* beatmap) {
+    difficulty_t* largest = NULL;
+    for (size_t i = 0; i < kv_size(beatmap->difficulties); i++) {
+        difficulty_t* d = &kv_A(beatmap->difficulties, i);
+        if (!largest || kv_size(d->hitobjects) > kv_size(largest->hitobjects))
+            largest = d;
+    }
+    return largest;
+}
+
+TEST_CASE("Beatmap loading benchmark", "[.][benchmark]") {
+    for (const fs::path& map : list_asset_maps()) {
+        const std::string path = map.string();
+        const std::string name = map.filename().string();
+
+        disable_cache();
+        BENCHMARK("beatmap_load " + name + " parsed") {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            beatmap_load(&beatmap, path.c_str());
+            beatmap_destroy(&beatmap);
+        };
+        BENCHMARK("beatmap_load_metadata " + name) {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            beatmap_load_metadata(&beatmap, path.c_str());
+            beatmap_destroy(&beatmap);
+        };
+
+        use_cache();
+        BENCHMARK("beatmap_load " + name + " cached") {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            beatmap_load(&beatmap, path.c_str());
+            beatmap_destroy(&beatmap);
+        };
+    }
+}
+
+TEST_CASE("Parser throughput benchmark", "[.][benchmark]") {
+    disable_cache();
+
+    std::vector<fs::path> sets = list_asset_maps();
+    sets.push_back(write_scaled_set("synthetic_40k", 40000, 2000));
+    sets.push_back(write_scaled_set("synthetic_1M", 1000000, 20000));
+
+    for (const fs::path& set : sets) {
+        const std::string path = set.string();
+        const double megabytes = get_osu_size(set) / 1e6;
+
+        BENCHMARK("parse " + set.filename().string()) {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            beatmap_load(&beatmap, path.c_str());
+            beatmap_destroy(&beatmap);
+        };
+
+        // Catch2 has no throughput reporting, the best of a few runs is close enough to compare
+        double best = 1e9;
+        for (int i = 0; i < 5; i++) {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            auto begin = std::chrono::steady_clock::now();
+            beatmap_load(&beatmap, path.c_str());
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+            beatmap_destroy(&beatmap);
+        }
+        std::printf("parse %s: %.2f MB in %.2f ms, %.1f MB/s\n", set.filename().string().c_str(), megabytes, best * 1e3, megabytes / best);
+    }
+}
+
+TEST_CASE("Timing point and playfield benchmark", "[.][benchmark]") {
+    use_cache();
+
+    std::vector<fs::path> sets = list_asset_maps();
+    sets.push_back(write_scaled_set("synthetic_100k", 100000, 5000));
+    sets.push_back(write_scaled_set("synthetic_1M", 1000000, 20000));
+
+    for (const fs::path& set : sets) {
+        const std::string name = set.filename().string();
+
+        beatmap_t beatmap;
+        {
+            quiet_stdout quiet;
+            REQUIRE(beatmap_load(&beatmap, set.string().c_str()) == ERROR_SUCCESS);
+        }
+        difficulty_t* d = find_largest_difficulty(&beatmap);
+        REQUIRE(d != NULL);
+
+        BENCHMARK("timing point lookup for every hit object " + name) {
+            int sum = 0;
+            for (size_t i = 0; i < kv_size(d->hitobjects); i++)
+                sum += difficulty_get_timing_point_index_for_time(d, kv_A(d->hitobjects, i).start_time);
+            return sum;
+        };
+
+        BENCHMARK("timing point cursor for every hit object " + name) {
+            timing_point_cursor_t cursor = {0};
+            int sum = 0;
+            for (size_t i = 0; i < kv_size(d->hitobjects); i++)
+                sum += difficulty_seek_timing_point(d, &cursor, kv_A(d->hitobjects, i).start_time);
+            return sum;
+        };
+
+        BENCHMARK("playfield_create_from " + name) {
+            quiet_stdout quiet;
+            playfield_t playfield;
+            playfield_create_from(d, &playfield);
+            playfield_destroy(&playfield);
+        };
+
+        beatmap_destroy(&beatmap);
+    }
+}
+
+TEST_CASE("Scaling benchmark", "[.][benchmark]") {
+    disable_cache();
+
+    // Ten times the notes at each step, timing points grow along at one per 50 notes
+    for (int note_count : { 10000, 100000, 1000000 }) {
+        synthetic_map_t map;
+        map.key_count = 10;
+        map.note_count = note_count;
+        map.hold_ratio = 0.3;
+        map.uninherited_count = note_count / 500;
+        map.inherited_count = note_count / 50 - map.uninherited_count;
+
+        const std::string name = std::to_string(note_count / 1000) + "k";
+        const std::string path = write_synthetic_set(("scaling_" + name).c_str(), map).string();
+
+        BENCHMARK("beatmap_load " + name) {
+            quiet_stdout quiet;
+            beatmap_t beatmap;
+            beatmap_load(&beatmap, path.c_str());
+            beatmap_destroy(&beatmap);
+        };
+
+        beatmap_t beatmap;
+        {
+            quiet_stdout quiet;
+            REQUIRE(beatmap_load(&beatmap, path.c_str()) == ERROR_SUCCESS);
+        }
+        difficulty_t* d = &kv_A(beatmap.difficulties, 0);
+
+        BENCHMARK("timing point lookup " + name) {
+            int sum = 0;
+            for (size_t i = 0; i < kv_size(d->hitobjects); i++)
+                sum += difficulty_get_timing_point_index_for_time(d, kv_A(d->hitobjects, i).start_time);
+            return sum;
+        };
+
+        BENCHMARK("playfield_create_from " + name) {
+            quiet_stdout quiet;
+            playfield_t playfield;
+            playfield_create_from(d, &playfield);
+            playfield_destroy(&playfield);
+        };
+
+        // A retry, every buffer is already big enough
+        playfield_t playfield;
+        {
+            quiet_stdout quiet;
+            REQUIRE(playfield_create_from(d, &playfield) == ERROR_SUCCESS);
+        }
+        BENCHMARK("playfield_rebuild " + name) {
+            quiet_stdout quiet;
+            return playfield_rebuild(&playfield, d);
+        };
+        playfield_destroy(&playfield);
+
+        beatmap_destroy(&beatmap);
+    }
+}
@@ -0,0 +1,201 @@
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+#if defined(_WIN32)
+    #include <stdlib.h>
+    #define setenv(name, value, overwrite) _putenv_s(name, value)
+    #define unsetenv(name) _putenv_s(name, "")
+#endif
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/reporters/catch_reporter_event_listener.hpp>
+#include <catch2/reporters/catch_reporter_registrars.hpp>
+
+#include "cmania.hpp"
+#include "synthetic_map.hpp"
+
+
+namespace fs = std::filesystem;
+
+// The tests are about the parser, files compiled by an earlier run would hide it.
+// Only the cache tests turn it on, in a directory of their own.
+struct cache_listener_t : Catch::EventListenerBase {
+    using Catch::EventListenerBase::EventListenerBase;
+
+    void testRunStarting(const Catch::TestRunInfo&) override {
+        cache_set_enabled(false);
+    }
+};
+CATCH_REGISTER_LISTENER(cache_listener_t)
+
+struct scoped_cache_t {
+    fs::path dir = fs::temp_directory_path() / "cmania_cache_test";
+
+    scoped_cache_t() {
+        fs::remove_all(dir);
+        setenv("CMANIA_CACHE_DIR", dir.string().c_str(), 1);
+        cache_set_enabled(true);
+    }
+    ~scoped_cache_t() {
+        cache_set_enabled(false);
+        unsetenv("CMANIA_CACHE_DIR");
+        fs::remove_all(dir);
+    }
+
+    fs::path get_path(uint64_t hash) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.cmb", (unsigned long long)hash);
+        return dir / name;
+    }
+};
+
+static uint64_t hash_file(const fs::path& path) {
+    uint64_t hash;
+    size_t size;
+    REQUIRE(cache_hash_file(path.string().c_str(), &hash, &size) == ERROR_SUCCESS);
+    return hash;
+}
+
+static error_t load_cached(const fs::path& path, difficulty_t* difficulty, bool* is_rejected) {
+    uint64_t hash;
+    size_t size;
+    REQUIRE(cache_hash_file(path.string().c_str(), &hash, &size) == ERROR_SUCCESS);
+
+    beatmap_t set;
+    memset(&set, 0, sizeof(set));
+    memset(difficulty, 0, sizeof(difficulty_t));
+    return cache_load(hash, size, &set, difficulty, is_rejected);
+}
+
+static void patch_file(const fs::path& path, size_t offset, uint32_t value) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write((const char*)&value, sizeof(value));
+}
+
+static void require_same(const beatmap_t& a, const beatmap_t& b) {
+    REQUIRE(a.id == b.id);
+    REQUIRE(std::string(a.title) == b.title);
+    REQUIRE(kv_size(a.difficulties) == kv_size(b.difficulties));
+
+    for (size_t i = 0; i < kv_size(a.difficulties); i++) {
+        const difficulty_t* da = &kv_A(a.difficulties, i);
+        const difficulty_t* db = &kv_A(b.difficulties, i);
+        REQUIRE(da->id == db->id);
+        REQUIRE(std::string(da->name) == db->name);
+        REQUIRE(std::string(da->file_name) == db->file_name);
+        REQUIRE(std::string(da->audio_filename) == db->audio_filename);
+        REQUIRE(da->preview_time == db->preview_time);
+        REQUIRE((da->HP == db->HP && da->CS == db->CS && da->OD == db->OD && da->SV == db->SV));
+        REQUIRE(da->hitobject_arrays.count == db->hitobject_arrays.count);
+
+        REQUIRE(kv_size(da->timing_points) == kv_size(db->timing_points));
+        REQUIRE(kv_size(da->hitobjects) == kv_size(db->hitobjects));
+        bool is_same = true;
+        for (size_t j = 0; j < kv_size(da->timing_points); j++) {
+            const timing_point_t* ta = &kv_A(da->timing_points, j);
+            const timing_point_t* tb = &kv_A(db->timing_points, j);
+            is_same = is_same && ta->time == tb->time && ta->BPM == tb->BPM && ta->SV == tb->SV;
+        }
+        for (size_t j = 0; j < kv_size(da->hitobjects); j++) {
+            const hitobject_t* ha = &kv_A(da->hitobjects, j);
+            const hitobject_t* hb = &kv_A(db->hitobjects, j);
+            is_same = is_same && ha->start_time == hb->start_time && ha->end_time == hb->end_time && ha->column == hb->column;
+        }
+        REQUIRE(is_same);
+    }
+}
+
+TEST_CASE("Compiled difficulty cache") {
+    const fs::path root = fs::temp_directory_path() / "cmania_cache_set";
+    const fs::path osu_path = root / "valid.osu";
+    const fs::path rejected_path = root / "rejected.osu";
+    fs::remove_all(root);
+    fs::create_directories(root);
+
+    synthetic_map_t map;
+    map.key_count = 4;
+    map.note_count = 500;
+    map.uninherited_count = 2;
+    map.inherited_count = 8;
+    std::string text = make_synthetic_osu(map);
+    std::ofstream(osu_path, std::ios::binary) << text;
+    std::ofstream(rejected_path, std::ios::binary) << text.replace(text.find("Mode: 3"), 7, "Mode: 0");
+
+    beatmap_t parsed;
+    REQUIRE(beatmap_load(&parsed, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(parsed.difficulties) == 1);
+
+    scoped_cache_t cache;
+    beatmap_t stored;
+    REQUIRE(beatmap_load(&stored, root.string().c_str()) == ERROR_SUCCESS);
+    require_same(parsed, stored);
+    REQUIRE(fs::exists(cache.get_path(hash_file(osu_path))));
+    REQUIRE(fs::exists(cache.get_path(hash_file(rejected_path))));
+
+    SECTION("store then load equals the parse") {
+        difficulty_t d;
+        bool is_rejected = true;
+        REQUIRE(load_cached(osu_path, &d, &is_rejected) == ERROR_SUCCESS);
+        REQUIRE(!is_rejected);
+        REQUIRE(kv_size(d.hitobjects) == 500);
+
+        // Owned by the difficulty like parsed vectors, not by the file
+        hitobject_t ho = { 1000000, 0, 1 };
+        region_kv_push(hitobject_t, d.region, d.hitobjects, ho);
+        REQUIRE(kv_size(d.hitobjects) == 501);
+        region_kv_destroy(d.region, d.timing_points);
+        region_kv_destroy(d.region, d.hitobjects);
+
+        beatmap_t loaded;
+        REQUIRE(beatmap_load(&loaded, root.string().c_str()) == ERROR_SUCCESS);
+        require_same(parsed, loaded);
+        beatmap_destroy(&loaded);
+    }
+
+    SECTION("a version or hash mismatch forces a reparse") {
+        // The version follows the 4 byte magic, the source hash comes after it
+        const fs::path cmb_path = cache.get_path(hash_file(osu_path));
+        difficulty_t d;
+        bool is_rejected;
+        for (size_t offset : { 4, 8 }) {
+            patch_file(cmb_path, offset, 0xdeadbeef);
+            REQUIRE(load_cached(osu_path, &d, &is_rejected) == ERROR_INVALID_FORMAT);
+
+            beatmap_t loaded;
+            REQUIRE(beatmap_load(&loaded, root.string().c_str()) == ERROR_SUCCESS);
+            require_same(parsed, loaded);
+            beatmap_destroy(&loaded);
+
+            REQUIRE(load_cached(osu_path, &d, &is_rejected) == ERROR_SUCCESS);
+            region_kv_destroy(d.region, d.timing_points);
+            region_kv_destroy(d.region, d.hitobjects);
+        }
+
+        // An edited file has a new hash, the old result is never used for it
+        map.note_count = 300;
+        std::ofstream(osu_path, std::ios::binary) << make_synthetic_osu(map);
+        beatmap_t edited;
+        REQUIRE(beatmap_load(&edited, root.string().c_str()) == ERROR_SUCCESS);
+        REQUIRE(kv_size(kv_A(edited.difficulties, 0).hitobjects) == 300);
+        beatmap_destroy(&edited);
+    }
+
+    SECTION("a rejected file stays rejected") {
+        difficulty_t d;
+        bool is_rejected = false;
+        REQUIRE(load_cached(rejected_path, &d, &is_rejected) == ERROR_SUCCESS);
+        REQUIRE(is_rejected);
+        REQUIRE(kv_size(d.hitobjects) == 0);
+
+        beatmap_t loaded;
+        REQUIRE(beatmap_load(&loaded, root.string().c_str()) == ERROR_SUCCESS);
+        require_same(parsed, loaded);
+        beatmap_destroy(&loaded);
+    }
+
+    beatmap_destroy(&stored);
+    beatmap_destroy(&parsed);
+    fs::remove_all(root);
+}
@@ -0,0 +1,105 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static std::vector<std::string> read_lines(chunk_reader_t* reader) {
+    std::vector<std::string> lines;
+    span_t line;
+    while (chunk_reader_next_line(reader, &line))
+        lines.emplace_back(line.data, line.size);
+    return lines;
+}
+
+TEST_CASE("Chunk reader returns the same lines as the lexer") {
+    // Lines cross the 64 KiB window many times, one is longer than the window
+    std::string text = "osu file format v14\r\n\r\n[HitObjects]\r\n";
+    for (int i = 0; i < 20000; i++)
+        text += std::to_string(i) + ",192," + std::to_string(i * 7) + ",1,0,0:0:0:0:\r\n";
+    text += "[Events]\n" + std::string(200000, 'x') + "\n// comment\nlast line";
+
+    const std::string path = (std::filesystem::temp_directory_path() / "cmania_chunk_reader.osu").string();
+    std::ofstream(path, std::ios::binary) << text;
+
+    lexer_t lexer;
+    lexer_init(&lexer, text.data(), text.size());
+    std::vector<std::string> expected;
+    span_t line;
+    while (lexer_next_line(&lexer, &line))
+        expected.emplace_back(line.data, line.size);
+    REQUIRE(expected.size() == 20005);
+    REQUIRE(expected.back() == "last line");
+    REQUIRE(lexer.lineno == 20007);
+
+    chunk_reader_t file;
+    REQUIRE(chunk_reader_open(&file, path.c_str(), 0) == ERROR_SUCCESS);
+    REQUIRE(read_lines(&file) == expected);
+    REQUIRE(file.lexer.lineno == lexer.lineno);
+    REQUIRE(chunk_reader_tell(&file) == text.size());
+    REQUIRE_FALSE(file.is_failed);
+    chunk_reader_close(&file);
+
+    SECTION("resuming at an offset") {
+        size_t offset = text.find("[Events]");
+
+        REQUIRE(chunk_reader_open(&file, path.c_str(), offset) == ERROR_SUCCESS);
+        std::vector<std::string> lines = read_lines(&file);
+        chunk_reader_close(&file);
+
+        REQUIRE(lines.size() == 3);
+        REQUIRE(lines[0] == "[Events]");
+        REQUIRE(lines[1].size() == 200000);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Chunk reader streams .osz entries") {
+    osz_t archive;
+    REQUIRE(osz_open(&archive, TESTS_ASSETS_DIR "/set.osz") == ERROR_SUCCESS);
+
+    // Every encoding of the test archive, the dynamic one is larger than the inflate window
+    for (size_t i = 0; i < kv_size(archive.entries); i++) {
+        CAPTURE(kv_A(archive.entries, i).name);
+        mapped_file_t contents;
+        REQUIRE(osz_extract(&archive, i, &contents) == ERROR_SUCCESS);
+        const std::string text(contents.data, contents.size);
+        mapped_file_unload(&contents);
+
+        lexer_t lexer;
+        lexer_init(&lexer, text.data(), text.size());
+        std::vector<std::string> expected;
+        span_t line;
+        while (lexer_next_line(&lexer, &line))
+            expected.emplace_back(line.data, line.size);
+
+        chunk_reader_t entry;
+        REQUIRE(chunk_reader_open_entry(&entry, &archive, i, 0) == ERROR_SUCCESS);
+        REQUIRE(read_lines(&entry) == expected);
+        REQUIRE(chunk_reader_tell(&entry) == text.size());
+        REQUIRE_FALSE(entry.is_failed);
+        chunk_reader_close(&entry);
+
+        size_t offset = text.find("[HitObjects]");
+        REQUIRE(chunk_reader_open_entry(&entry, &archive, i, offset) == ERROR_SUCCESS);
+        std::vector<std::string> lines = read_lines(&entry);
+        chunk_reader_close(&entry);
+        REQUIRE(lines.size() > 1);
+        REQUIRE(lines[0] == "[HitObjects]");
+        REQUIRE(lines.back() == expected.back());
+
+        REQUIRE(chunk_reader_open_entry(&entry, &archive, i, text.size() + 1) != ERROR_SUCCESS);
+    }
+
+    osz_close(&archive);
+}
+
+TEST_CASE("Chunk reader reports missing files") {
+    chunk_reader_t reader;
+    REQUIRE(chunk_reader_open(&reader, "does/not/exist.osu", 0) == ERROR_FILE_NOT_FOUND);
+}
@@ -0,0 +1,34 @@
+#ifndef TESTS_CMANIA_HPP
+#define TESTS_CMANIA_HPP
+
+// g++ always defines _GNU_SOURCE, which makes glibc's <errno.h> declare its own
+// `error_t`. Pull the standard headers in first and rename ours.
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define error_t cmania_error_t
+
+// <stdatomic.h> is C++23, before that the watcher's flag is the std:: one of the
+// same layout
+#include <atomic>
+using std::atomic_bool;
+
+extern "C" {
+#include "util.h"
+#include "lexer.h"
+#include "chunk_reader.h"
+#include "beatmap.h"
+#include "osu_keys.h"
+#include "region.h"
+#include "playfield.h"
+#include "library.h"
+#include "library_watcher.h"
+#include "cache.h"
+#include "osz.h"
+#include "inflate.h"
+}
+
+
+#endif
@@ -0,0 +1,172 @@
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static bool is_cache_aligned(const void* p) {
+    return (uintptr_t)p % 64 == 0;
+}
+
+static void require_in_sync(difficulty_t* d) {
+    const hitobject_arrays_t* arrays = &d->hitobject_arrays;
+    REQUIRE(arrays->count == kv_size(d->hitobjects));
+    if (arrays->count == 0)
+        return;
+
+    REQUIRE(is_cache_aligned(arrays->start));
+    REQUIRE(is_cache_aligned(arrays->end));
+    REQUIRE(is_cache_aligned(arrays->column));
+
+    bool is_same = true;
+    for (size_t i = 0; i < arrays->count; i++) {
+        const hitobject_t* ho = &kv_A(d->hitobjects, i);
+        is_same = is_same
+            && arrays->start[i] == ho->start_time
+            && arrays->end[i] == ho->end_time
+            && arrays->column[i] == ho->column;
+    }
+    REQUIRE(is_same);
+
+    // Every object once, in the range of its column, in time order
+    REQUIRE(arrays->column_count >= (int)d->CS);
+    REQUIRE(arrays->column_offsets[0] == 0);
+    REQUIRE(arrays->column_offsets[arrays->column_count] == arrays->count);
+
+    std::vector<int> seen(arrays->count, 0);
+    bool is_partitioned = true;
+    for (int k = 0; k < arrays->column_count; k++) {
+        for (uint32_t j = arrays->column_offsets[k]; j < arrays->column_offsets[k + 1]; j++) {
+            uint32_t i = arrays->by_column[j];
+            seen[i]++;
+            is_partitioned = is_partitioned && arrays->column[i] == k;
+            if (j > arrays->column_offsets[k])
+                is_partitioned = is_partitioned && arrays->by_column[j - 1] < i;
+        }
+    }
+    REQUIRE(is_partitioned);
+    REQUIRE(std::count(seen.begin(), seen.end(), 1) == (long)arrays->count);
+}
+
+static void require_playfield_matches(difficulty_t* d) {
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(d, &playfield) == ERROR_SUCCESS);
+
+    // Same events as pushing every object into its column in time order
+    std::vector<std::vector<std::pair<float, int>>> expected(kv_size(playfield.columns));
+    for (size_t i = 0; i < kv_size(d->hitobjects); i++) {
+        const hitobject_t* ho = &kv_A(d->hitobjects, i);
+        if (ho->end_time) {
+            expected[ho->column].push_back({ playfield_get_position(&playfield, ho->start_time), PLAYFIELD_EVENT_HOLD_BEGIN });
+            expected[ho->column].push_back({ playfield_get_position(&playfield, ho->end_time), PLAYFIELD_EVENT_HOLD_END });
+        }
+        else {
+            expected[ho->column].push_back({ playfield_get_position(&playfield, ho->start_time), PLAYFIELD_EVENT_NOTE });
+        }
+    }
+
+    for (size_t k = 0; k < kv_size(playfield.columns); k++) {
+        playfield_column_t* pc = &kv_A(playfield.columns, k);
+        std::vector<std::pair<float, int>> actual;
+        for (size_t j = 0; j < kv_size(pc->positions); j++)
+            actual.push_back({ playfield_get_event(pc, j).position, playfield_get_event(pc, j).type });
+        REQUIRE(actual == expected[k]);
+    }
+
+    playfield_destroy(&playfield);
+}
+
+TEST_CASE("Hit object arrays") {
+    SECTION("loaded beatmap") {
+        beatmap_t beatmap;
+        REQUIRE(beatmap_load(&beatmap, ASSETS_DIR "/map1") == ERROR_SUCCESS);
+        REQUIRE(kv_size(beatmap.difficulties) > 0);
+
+        for (size_t i = 0; i < kv_size(beatmap.difficulties); i++) {
+            require_in_sync(&kv_A(beatmap.difficulties, i));
+            require_playfield_matches(&kv_A(beatmap.difficulties, i));
+        }
+
+        beatmap_destroy(&beatmap);
+    }
+
+    SECTION("body loaded later") {
+        beatmap_t beatmap;
+        REQUIRE(beatmap_load_metadata(&beatmap, ASSETS_DIR "/map1") == ERROR_SUCCESS);
+        difficulty_t* d = &kv_A(beatmap.difficulties, 0);
+        REQUIRE(d->hitobject_arrays.count == 0);
+
+        REQUIRE(difficulty_load_body(&beatmap, d) == ERROR_SUCCESS);
+        REQUIRE(d->hitobject_arrays.count > 0);
+        require_in_sync(d);
+
+        beatmap_destroy(&beatmap);
+    }
+
+    SECTION("rebuilt by hand") {
+        difficulty_t d;
+        memset(&d, 0, sizeof(d));
+        d.region = region_create();
+        d.CS = 7;
+
+        for (int i = 0; i < 1000; i++) {
+            hitobject_t ho = { i * 50, (i % 3 == 0) ? (i * 50 + 200) : (0), i % 7 };
+            region_kv_push(hitobject_t, d.region, d.hitobjects, ho);
+            if (i % 100 == 0) {
+                REQUIRE(difficulty_build_hitobject_arrays(&d) == ERROR_SUCCESS);
+                require_in_sync(&d);
+            }
+        }
+        REQUIRE(difficulty_build_hitobject_arrays(&d) == ERROR_SUCCESS);
+        require_in_sync(&d);
+
+        // Not rebuilt after this push, the playfield notices
+        hitobject_t last = { 60000, 0, 3 };
+        region_kv_push(hitobject_t, d.region, d.hitobjects, last);
+        require_playfield_matches(&d);
+        require_in_sync(&d);
+
+        region_destroy(d.region);
+    }
+}
+
+TEST_CASE("Packed playfield events") {
+    difficulty_t d;
+    memset(&d, 0, sizeof(d));
+    d.region = region_create();
+    d.CS = 1;
+
+    // Every alignment of a hold pair within the 2-bit type bytes
+    timing_point_t tm = { 0, 120, 1 };
+    region_kv_push(timing_point_t, d.region, d.timing_points, tm);
+    std::vector<int> expected;
+    for (int i = 0; i < 101; i++) {
+        bool is_hold = i % 3 == 1 || i % 7 == 0;
+        hitobject_t ho = { i * 1000, (is_hold) ? (i * 1000 + 500) : (0), 0 };
+        region_kv_push(hitobject_t, d.region, d.hitobjects, ho);
+        if (is_hold) {
+            expected.push_back(PLAYFIELD_EVENT_HOLD_BEGIN);
+            expected.push_back(PLAYFIELD_EVENT_HOLD_END);
+        }
+        else {
+            expected.push_back(PLAYFIELD_EVENT_NOTE);
+        }
+    }
+
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+    playfield_column_t* pc = &kv_A(playfield.columns, 0);
+    REQUIRE(kv_size(pc->positions) == expected.size());
+
+    std::vector<int> types;
+    for (size_t i = 0; i < kv_size(pc->positions); i++)
+        types.push_back(playfield_get_event_type(pc, i));
+    REQUIRE(types == expected);
+
+    playfield_destroy(&playfield);
+    region_destroy(d.region);
+}
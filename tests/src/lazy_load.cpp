@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+// The whole .osu a difficulty was loaded from
+static std::string read_source(const beatmap_t* beatmap, const difficulty_t* d) {
+    if (beatmap->archive == NULL) {
+        std::ifstream file(d->path, std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    int index = osz_find_entry(beatmap->archive, d->path);
+    REQUIRE(index >= 0);
+    mapped_file_t contents;
+    REQUIRE(osz_extract(beatmap->archive, index, &contents) == ERROR_SUCCESS);
+    std::string text(contents.data, contents.size);
+    mapped_file_unload(&contents);
+    return text;
+}
+
+static std::string read_line(const std::string& source, size_t offset) {
+    lexer_t lexer;
+    lexer_init(&lexer, source.data() + offset, source.size() - offset);
+    span_t line;
+    REQUIRE(lexer_next_line(&lexer, &line));
+    return std::string(line.data, line.size);
+}
+
+static bool has_same_body(const difficulty_t* a, const difficulty_t* b) {
+    return kv_size(a->timing_points) == kv_size(b->timing_points)
+        && kv_size(a->hitobjects) == kv_size(b->hitobjects)
+        && memcmp(a->timing_points.a, b->timing_points.a, kv_size(a->timing_points) * sizeof(timing_point_t)) == 0
+        && memcmp(a->hitobjects.a, b->hitobjects.a, kv_size(a->hitobjects) * sizeof(hitobject_t)) == 0;
+}
+
+TEST_CASE("Loading the body after the metadata") {
+    cache_set_enabled(false);
+
+    for (const char* path : { ASSETS_DIR "/map2", TESTS_ASSETS_DIR "/set.osz" }) {
+        CAPTURE(path);
+        beatmap_t full, lazy;
+        REQUIRE(beatmap_load(&full, path) == ERROR_SUCCESS);
+        REQUIRE(beatmap_load_metadata(&lazy, path) == ERROR_SUCCESS);
+        REQUIRE(kv_size(lazy.difficulties) == kv_size(full.difficulties));
+        REQUIRE(kv_size(lazy.difficulties) > 1);
+
+        for (size_t i = 0; i < kv_size(lazy.difficulties); i++) {
+            difficulty_t* d = &kv_A(lazy.difficulties, i);
+            const difficulty_t* expected = &kv_A(full.difficulties, i);
+            CAPTURE(d->file_name);
+            REQUIRE(d->id == expected->id);
+            REQUIRE(!d->is_body_loaded);
+            REQUIRE(kv_size(d->timing_points) == 0);
+            REQUIRE(kv_size(d->hitobjects) == 0);
+
+            const std::string source = read_source(&lazy, d);
+            REQUIRE(d->source_size == source.size());
+            // Only empty and comment lines may sit between the offset and the header
+            const size_t header = std::min(source.find("[TimingPoints]"), source.find("[HitObjects]"));
+            REQUIRE(d->body_offset <= header);
+            REQUIRE(read_line(source, d->body_offset) == read_line(source, header));
+
+            REQUIRE(difficulty_load_body(&lazy, d) == ERROR_SUCCESS);
+            REQUIRE(d->is_body_loaded);
+            REQUIRE(kv_size(d->hitobjects) > 0);
+            REQUIRE(has_same_body(d, expected));
+            REQUIRE(d->hitobject_arrays.count == kv_size(d->hitobjects));
+        }
+
+        beatmap_destroy(&lazy);
+        beatmap_destroy(&full);
+    }
+}
+
+TEST_CASE("Loading the body of a modified file") {
+    namespace fs = std::filesystem;
+    cache_set_enabled(false);
+
+    const fs::path root = fs::temp_directory_path() / "cmania_lazy_load";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    fs::copy_file(ASSETS_DIR "/map1/map.osu", root / "map.osu");
+
+    beatmap_t beatmap;
+    REQUIRE(beatmap_load_metadata(&beatmap, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(beatmap.difficulties) == 1);
+    difficulty_t* d = &kv_A(beatmap.difficulties, 0);
+
+    std::ofstream(root / "map.osu", std::ios::binary | std::ios::app) << "64,192,999999,1,0,0:0:0:0:\n";
+    REQUIRE(difficulty_load_body(&beatmap, d) == ERROR_INVALID_FORMAT);
+    REQUIRE(!d->is_body_loaded);
+    REQUIRE(kv_size(d->hitobjects) == 0);
+
+    beatmap_destroy(&beatmap);
+    fs::remove_all(root);
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <clocale>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static std::string to_string(span_t s) {
+    return std::string(s.data, s.size);
+}
+
+// Contents of every .osu in the assets, loose or inside an .osz
+static std::vector<std::string> read_asset_files() {
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> files;
+    for (const char* dir : { ASSETS_DIR, TESTS_ASSETS_DIR }) {
+        for (const fs::directory_entry& entry : fs::recursive_directory_iterator(dir)) {
+            std::string path = entry.path().string();
+            if (entry.path().extension() == ".osu") {
+                mapped_file_t contents;
+                REQUIRE(mapped_file_load(&contents, path.c_str()) == ERROR_SUCCESS);
+                files.push_back(std::string(contents.data, contents.size));
+                mapped_file_unload(&contents);
+            }
+            else if (entry.path().extension() == ".osz") {
+                osz_t archive;
+                REQUIRE(osz_open(&archive, path.c_str()) == ERROR_SUCCESS);
+                for (size_t i = 0; i < kv_size(archive.entries); i++) {
+                    if (fs::path(kv_A(archive.entries, i).name).extension() != ".osu")
+                        continue;
+                    mapped_file_t contents;
+                    REQUIRE(osz_extract(&archive, (int)i, &contents) == ERROR_SUCCESS);
+                    files.push_back(std::string(contents.data, contents.size));
+                    mapped_file_unload(&contents);
+                }
+                osz_close(&archive);
+            }
+        }
+    }
+    return files;
+}
+
+TEST_CASE("Lexer skips empty and comment lines") {
+    const std::string text = "osu file format v14\r\n\r\n[General]\r\n  Mode: 3  \r\n//comment\n;comment\nlast";
+
+    lexer_t lexer;
+    span_t line;
+    lexer_init(&lexer, text.data(), text.size());
+
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(to_string(line) == "osu file format v14");
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(to_string(line) == "[General]");
+    REQUIRE(lexer.lineno == 3);
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(to_string(line) == "Mode: 3");
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(to_string(line) == "last");
+    REQUIRE(lexer.lineno == 7);
+    REQUIRE_FALSE(lexer_next_line(&lexer, &line));
+}
+
+TEST_CASE("Lexer has no line length limit") {
+    std::string tags = "Tags:" + std::string(5000, 'a');
+    const std::string text = tags + "\nBeatmapID:1\n";
+
+    lexer_t lexer;
+    span_t line;
+    lexer_init(&lexer, text.data(), text.size());
+
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(line.size == tags.size());
+    REQUIRE(lexer_next_line(&lexer, &line));
+    REQUIRE(to_string(line) == "BeatmapID:1");
+}
+
+TEST_CASE("Lexer splits fields across SIMD block boundaries") {
+    std::string text;
+    for (int i = 0; i < 100; i++)
+        text += std::to_string(i) + (i < 99 ? "," : "");
+
+    span_t fields[128];
+    int count = lexer_split({ text.data(), text.size() }, ',', fields, 128);
+
+    REQUIRE(count == 100);
+    for (int i = 0; i < count; i++)
+        REQUIRE(span_to_int(fields[i]) == i);
+
+    // Fields past `max_fields` are counted but not stored
+    REQUIRE(lexer_split({ text.data(), text.size() }, ',', fields, 8) == 100);
+}
+
+TEST_CASE("Lexer parses hit object fields") {
+    const std::string line = "64,192,27797,128,0,28797:0:0:0:";
+
+    span_t fields[8];
+    REQUIRE(lexer_split({ line.data(), line.size() }, ',', fields, 8) == 6);
+    REQUIRE(span_to_int(fields[0]) == 64);
+    REQUIRE(span_to_int(fields[2]) == 27797);
+    REQUIRE(span_to_int(fields[5]) == 28797);
+    REQUIRE(span_to_int({ "-15", 3 }) == -15);
+    REQUIRE(span_to_double({ "-83.3333333333333", 17 }) == -83.3333333333333);
+}
+
+TEST_CASE("Numeric fields report where they end") {
+    const std::string sample = "12345:0:0:0:70:hit.wav";
+    const char* end = sample.data() + sample.size();
+
+    int value;
+    const char* p = lexer_parse_int(sample.data(), end, &value);
+    REQUIRE(value == 12345);
+    REQUIRE(*p == ':');
+
+    int fields[5];
+    p = sample.data();
+    for (int i = 0; i < 5; i++) {
+        p = lexer_parse_int(p, end, &fields[i]);
+        REQUIRE(*p == ':');
+        p++;
+    }
+    REQUIRE(fields[4] == 70);
+    REQUIRE(lexer_parse_int(p, end, &value) == p);
+
+    double d;
+    const std::string beat_length = "-133.333333333333,4";
+    p = lexer_parse_double(beat_length.data(), beat_length.data() + beat_length.size(), &d);
+    REQUIRE(d == strtod(beat_length.c_str(), NULL));
+    REQUIRE(*p == ',');
+
+    REQUIRE(span_to_double({ "1.5e2", 5 }) == 150.0);
+    REQUIRE(span_to_double({ "0.0001", 6 }) == 0.0001);
+    REQUIRE(span_to_double({ "  461.538461538462 ", 19 }) == 461.538461538462);
+    REQUIRE(span_to_double({ "-.5", 3 }) == -0.5);
+    REQUIRE(span_to_double({ "abc", 3 }) == 0.0);
+    REQUIRE(span_to_int({ "-42.9", 5 }) == -42);
+    REQUIRE(span_to_int({ "+7", 2 }) == 7);
+    REQUIRE(span_to_int({ "-", 1 }) == 0);
+}
+
+TEST_CASE("Numeric fields match strtol and strtod") {
+    std::string locale = setlocale(LC_NUMERIC, NULL);
+    setlocale(LC_NUMERIC, "C");
+
+    std::vector<std::string> files = read_asset_files();
+    REQUIRE(files.size() > 0);
+
+    size_t field_count = 0;
+    std::vector<std::string> mismatches;
+    for (const std::string& file : files) {
+        lexer_t lexer;
+        lexer_init(&lexer, file.data(), file.size());
+
+        bool is_data_section = false;
+        span_t line;
+        while (lexer_next_line(&lexer, &line)) {
+            if (line.data[0] == '[') {
+                std::string section = to_string(line);
+                is_data_section = section == "[TimingPoints]" || section == "[HitObjects]";
+                continue;
+            }
+            if (!is_data_section)
+                continue;
+
+            // strtol() and strtod() need a terminator, parsing may run up to the end of the line
+            const std::string text = to_string(line);
+            const char* end = text.c_str() + text.size();
+            for (const char* field = text.c_str(); field <= end; field++) {
+                int int_value;
+                double double_value;
+                char* int_end;
+                char* double_end;
+                const char* p = lexer_parse_int(field, end, &int_value);
+                long expected_int = strtol(field, &int_end, 10);
+                if (p != int_end || int_value != (int)expected_int)
+                    mismatches.push_back("int " + std::string(field));
+
+                p = lexer_parse_double(field, end, &double_value);
+                double expected_double = strtod(field, &double_end);
+                if (p != double_end || double_value != expected_double)
+                    mismatches.push_back("double " + std::string(field));
+                field_count++;
+
+                field = std::find_if(field, end, [](char c) { return c == ',' || c == ':' || c == '|'; });
+            }
+        }
+    }
+
+    setlocale(LC_NUMERIC, locale.c_str());
+    INFO((mismatches.empty() ? std::string() : mismatches[0]));
+    REQUIRE(mismatches.empty());
+    REQUIRE(field_count > 100000);
+}
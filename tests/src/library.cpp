@@ -0,0 +1,292 @@
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <set>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static void write_difficulty(const std::filesystem::path& path, int set_id, int id, const char* version) {
+    std::ofstream(path, std::ios::binary)
+        << "osu file format v14\n\n"
+        << "[General]\nAudioFilename: audio.mp3\nMode: 3\n\n"
+        << "[Metadata]\nTitle:Set " << set_id << "\nVersion:" << version << "\n"
+        << "BeatmapID:" << id << "\nBeatmapSetID:" << set_id << "\n\n"
+        << "[Difficulty]\nCircleSize:" << (id % 2 ? 7 : 4) << "\n\n"
+        << "[TimingPoints]\n0,500,4,2,1,40,1,0\n\n"
+        << "[HitObjects]\n64,192,1000,1,0,0:0:0:0:\n";
+}
+
+// Bytes of the string table nothing refers to, the empty string at 0 is always in use
+static size_t get_unused_strings_size(const library_t* library) {
+    std::set<uint32_t> offsets = { 0 };
+    for (size_t i = 0; i < kv_size(library->sets); i++)
+        offsets.insert(kv_A(library->sets, i).path);
+    for (size_t i = 0; i < kv_size(library->entries); i++) {
+        const library_entry_t* entry = &kv_A(library->entries, i);
+        offsets.insert({ entry->title, entry->version, entry->audio_filename, entry->set_path, entry->path });
+    }
+
+    size_t size = kv_size(library->strings);
+    for (uint32_t offset : offsets)
+        size -= strlen(library_string(library, offset)) + 1;
+    return size;
+}
+
+TEST_CASE("Library scan, save and load") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_library";
+    const std::string index_path = (fs::temp_directory_path() / "cmania_library.cml").string();
+    fs::remove_all(root);
+    fs::create_directories(root / "2 B");
+    fs::create_directories(root / "1 A");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easy");
+    write_difficulty(root / "1 A" / "hard.osu", 1, 12, "Hard");
+    write_difficulty(root / "2 B" / "normal.osu", 2, 5, "Normal");
+
+    library_t scanned;
+    REQUIRE(library_scan(&scanned, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(scanned.entries) == 3);
+    REQUIRE(kv_A(scanned.entries, 0).id == 5);  // sorted by id
+    REQUIRE(library_save(&scanned, index_path.c_str()) == ERROR_SUCCESS);
+
+    library_t library;
+    REQUIRE(library_load(&library, index_path.c_str()) == ERROR_SUCCESS);
+    REQUIRE(std::string(library.root) == root.string());
+    REQUIRE(kv_size(library.entries) == 3);
+
+    const library_entry_t* entry = library_find(&library, 12);
+    REQUIRE(entry != NULL);
+    REQUIRE(entry->set_id == 1);
+    REQUIRE(entry->CS == 4);
+    REQUIRE(std::string(library_string(&library, entry->title)) == "Set 1");
+    REQUIRE(std::string(library_string(&library, entry->version)) == "Hard");
+    REQUIRE(std::string(library_string(&library, entry->audio_filename)) == "audio.mp3");
+    REQUIRE(fs::path(library_string(&library, entry->set_path)) == root / "1 A");
+    REQUIRE(entry->size == fs::file_size(root / "1 A" / "hard.osu"));
+    REQUIRE(entry->mtime != 0);
+
+    REQUIRE(library_find(&library, 0) == NULL);
+    REQUIRE(library_find(&library, 6) == NULL);
+    REQUIRE(library_find(&library, 100) == NULL);
+
+    SECTION("opening reuses the index of the same root") {
+        library_t opened;
+        REQUIRE(library_open(&opened, root.string().c_str(), index_path.c_str()) == ERROR_SUCCESS);
+        REQUIRE(kv_size(opened.entries) == 3);
+        REQUIRE(library_reconcile(&opened) == 0);
+        library_destroy(&opened);
+    }
+
+    SECTION("reconciling catches offline changes") {
+        write_difficulty(root / "1 A" / "hard.osu", 1, 12, "Harder");
+        fs::last_write_time(root / "1 A" / "hard.osu", fs::file_time_type::clock::now() + std::chrono::hours(1));
+        fs::remove_all(root / "2 B");
+        fs::create_directories(root / "3 C");
+        write_difficulty(root / "3 C" / "insane.osu", 3, 30, "Insane");
+
+        REQUIRE(library_reconcile(&library) == 3);
+        REQUIRE(kv_size(library.entries) == 3);
+        REQUIRE(kv_size(library.sets) == 2);
+        REQUIRE(library_find(&library, 5) == NULL);
+        REQUIRE(library_find(&library, 30) != NULL);
+        REQUIRE(std::string(library_string(&library, library_find(&library, 12)->version)) == "Harder");
+        REQUIRE(library_reconcile(&library) == 0);
+    }
+
+    SECTION("updating a set reuses the string table") {
+        size_t strings_size = kv_size(library.strings);
+        for (int i = 0; i < 20; i++)
+            REQUIRE(library_update_set(&library, (root / "1 A").string().c_str()) == ERROR_SUCCESS);
+
+        REQUIRE(kv_size(library.entries) == 3);
+        REQUIRE(kv_size(library.strings) < strings_size * 2);
+        REQUIRE(std::string(library_string(&library, library_find(&library, 11)->version)) == "Easy");
+        REQUIRE(std::string(library_string(&library, library_find(&library, 5)->title)) == "Set 2");
+    }
+
+    SECTION("damaged indexes are rejected") {
+        fs::resize_file(index_path, fs::file_size(index_path) - 1);
+        library_t damaged;
+        REQUIRE(library_load(&damaged, index_path.c_str()) != ERROR_SUCCESS);
+    }
+
+    library_destroy(&scanned);
+    library_destroy(&library);
+    fs::remove_all(root);
+    fs::remove(index_path);
+}
+
+// Entries of `library` as "id version" in id order
+static std::string describe(const library_t* library) {
+    std::string description;
+    for (size_t i = 0; i < kv_size(library->entries); i++) {
+        const library_entry_t* entry = &kv_A(library->entries, i);
+        description += std::to_string(entry->id) + " " + library_string(library, entry->version) + "\n";
+    }
+    return description;
+}
+
+static std::string describe_index(const std::string& index_path) {
+    library_t library;
+    if (library_load(&library, index_path.c_str()) != ERROR_SUCCESS)
+        return "";
+    std::string description = describe(&library);
+    library_destroy(&library);
+    return description;
+}
+
+TEST_CASE("Library opening reconciles the index") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_library_open";
+    const std::string index_path = (fs::temp_directory_path() / "cmania_library_open.cml").string();
+    fs::remove_all(root);
+    fs::remove(index_path);
+    fs::create_directories(root / "1 A");
+    fs::create_directories(root / "2 B");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easy");
+    write_difficulty(root / "2 B" / "normal.osu", 2, 5, "Normal");
+
+    library_t library;
+    REQUIRE(library_open(&library, root.string().c_str(), index_path.c_str()) == ERROR_SUCCESS);
+    REQUIRE(describe(&library) == "5 Normal\n11 Easy\n");
+    REQUIRE(describe_index(index_path) == describe(&library));
+    library_destroy(&library);
+
+    // Created, modified and deleted while the game was closed
+    fs::create_directories(root / "3 C");
+    write_difficulty(root / "3 C" / "insane.osu", 3, 30, "Insane");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easier");
+    fs::last_write_time(root / "1 A" / "easy.osu", fs::file_time_type::clock::now() + std::chrono::hours(1));
+    fs::remove_all(root / "2 B");
+
+    REQUIRE(library_open(&library, root.string().c_str(), index_path.c_str()) == ERROR_SUCCESS);
+    REQUIRE(describe(&library) == "11 Easier\n30 Insane\n");
+    REQUIRE(kv_size(library.sets) == 2);
+    REQUIRE(describe_index(index_path) == describe(&library));
+    library_destroy(&library);
+
+    fs::remove_all(root);
+    fs::remove(index_path);
+}
+
+TEST_CASE("Library keeps its sets while the root is missing") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_library_missing";
+    const fs::path moved = fs::temp_directory_path() / "cmania_library_missing_moved";
+    fs::remove_all(root);
+    fs::remove_all(moved);
+    fs::create_directories(root / "1 A");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easy");
+
+    library_t library;
+    REQUIRE(library_scan(&library, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(library.sets) == 1);
+
+    // An unmounted drive looks the same, it must not empty the library
+    fs::rename(root, moved);
+    path_list_t paths;
+    REQUIRE(library_list_changed_sets(&library, &paths) == ERROR_FILE_NOT_FOUND);
+    REQUIRE(kv_size(paths) == 0);
+    path_list_destroy(&paths);
+    REQUIRE(library_reconcile(&library) == 0);
+    REQUIRE(describe(&library) == "11 Easy\n");
+
+    fs::rename(moved, root);
+    REQUIRE(library_list_changed_sets(&library, &paths) == ERROR_SUCCESS);
+    REQUIRE(kv_size(paths) == 0);
+    path_list_destroy(&paths);
+
+    library_destroy(&library);
+    fs::remove_all(root);
+}
+
+#if defined(__linux__)
+// Polls until `is_done` holds, the watcher waits for files to settle before parsing
+static bool wait_for(const std::function<bool()>& is_done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!is_done()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+TEST_CASE("Library watcher") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_library_watcher";
+    const std::string index_path = (fs::temp_directory_path() / "cmania_library_watcher.cml").string();
+    fs::remove_all(root);
+    fs::remove(index_path);
+    fs::create_directories(root / "1 A");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easy");
+
+    library_t library;
+    REQUIRE(library_open(&library, root.string().c_str(), index_path.c_str()) == ERROR_SUCCESS);
+
+    library_watcher_t watcher;
+    REQUIRE(library_watcher_start(&watcher, &library, index_path.c_str()) == ERROR_SUCCESS);
+
+    auto is_described_as = [&](const std::string& expected) {
+        return wait_for([&] {
+            library_watcher_lock(&watcher);
+            bool is_updated = describe(&library) == expected;
+            library_watcher_unlock(&watcher);
+            return is_updated;
+        }) && wait_for([&] { return describe_index(index_path) == expected; });
+    };
+
+    fs::create_directories(root / "2 B");
+    write_difficulty(root / "2 B" / "normal.osu", 2, 5, "Normal");
+    REQUIRE(is_described_as("5 Normal\n11 Easy\n"));
+
+    write_difficulty(root / "2 B" / "normal.osu", 2, 5, "Hard");
+    REQUIRE(is_described_as("5 Hard\n11 Easy\n"));
+
+    fs::remove_all(root / "1 A");
+    REQUIRE(is_described_as("5 Hard\n"));
+
+    library_watcher_stop(&watcher);
+    library_destroy(&library);
+    fs::remove_all(root);
+    fs::remove(index_path);
+}
+#endif
+
+TEST_CASE("Library string accounting") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_library_strings";
+    fs::remove_all(root);
+    fs::create_directories(root / "1 A");
+    fs::create_directories(root / "2 B");
+    fs::create_directories(root / "3 C");
+    write_difficulty(root / "1 A" / "easy.osu", 1, 11, "Easy");
+    write_difficulty(root / "1 A" / "hard.osu", 1, 12, "Hard");
+    write_difficulty(root / "2 B" / "normal.osu", 2, 5, "Normal");
+    write_difficulty(root / "2 B" / "hard.osu", 2, 6, "Hard");
+    for (int i = 0; i < 10; i++)  // keeps the removed strings below the compaction threshold
+        write_difficulty(root / "3 C" / ("diff" + std::to_string(i) + ".osu"), 3, 100 + i, "Difficulty");
+
+    library_t library;
+    REQUIRE(library_scan(&library, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(library.unused_strings_size == 0);
+    REQUIRE(get_unused_strings_size(&library) == 0);
+
+    // Set 2 has the lowest ids, its entries come first. Set 1 comes after a kept entry.
+    for (const char* name : { "2 B", "1 A" }) {
+        fs::remove_all(root / name);
+        REQUIRE(library_update_set(&library, (root / name).string().c_str()) == ERROR_SUCCESS);
+        REQUIRE(library.unused_strings_size > 0);
+        REQUIRE(library.unused_strings_size == get_unused_strings_size(&library));
+    }
+    REQUIRE(kv_size(library.entries) == 10);
+
+    library_destroy(&library);
+    fs::remove_all(root);
+}
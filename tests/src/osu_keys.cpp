@@ -0,0 +1,31 @@
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+static span_t to_span(const std::string& s) {
+    return { s.data(), s.size() };
+}
+
+TEST_CASE("Section and key lookup") {
+    REQUIRE(osu_find_section(to_span("General")) == SECTION_GENERAL);
+    REQUIRE(osu_find_section(to_span("TimingPoints")) == SECTION_TIMING_POINTS);
+    REQUIRE(osu_find_section(to_span("HitObjects")) == SECTION_HITOBJECTS);
+    REQUIRE(osu_find_key(to_span("CircleSize")) == KEY_CS);
+    REQUIRE(osu_find_key(to_span("OverallDifficulty")) == KEY_OD);
+    REQUIRE(osu_find_key(to_span("HPDrainRate")) == KEY_HP);
+    REQUIRE(osu_find_key(to_span("PreviewTime")) == KEY_PREVIEW_TIME);
+    REQUIRE(osu_find_key(to_span("BeatmapSetID")) == KEY_BEATMAPSET_ID);
+}
+
+TEST_CASE("Unknown names do not alias known ones") {
+    // Same length, first, middle and last characters as known names, so same slot
+    REQUIRE(osu_find_section(to_span("Gxxexxl")) == SECTION_UNKNOWN);
+    REQUIRE(osu_find_key(to_span("CxxxxSxxxe")) == KEY_UNKNOWN);
+    REQUIRE(osu_find_key(to_span("circlesize")) == KEY_UNKNOWN);
+    REQUIRE(osu_find_key(to_span("CircleSize ")) == KEY_UNKNOWN);
+    REQUIRE(osu_find_key(to_span("")) == KEY_UNKNOWN);
+    REQUIRE(osu_find_section(to_span("")) == SECTION_UNKNOWN);
+}
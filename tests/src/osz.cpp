@@ -0,0 +1,339 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+// Made by tools/gen_test_osz.py, one difficulty per encoding
+static const char* const OSZ_PATH = TESTS_ASSETS_DIR "/set.osz";
+
+static std::vector<char> read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::filesystem::path& path, const std::vector<char>& data) {
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+}
+
+static uint32_t read_u16(const char* p) {
+    const uint8_t* b = (const uint8_t*)p;
+    return b[0] | (b[1] << 8);
+}
+
+static uint32_t read_u32(const char* p) {
+    const uint8_t* b = (const uint8_t*)p;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+// Offset of an entry's data, right after its local header
+static size_t get_data_offset(const char* archive, const osz_entry_t* entry) {
+    const char* header = archive + entry->offset;
+    return entry->offset + 30 + read_u16(header + 26) + read_u16(header + 28);
+}
+
+static error_t inflate_string(const std::string& stream, size_t out_size, std::string* out) {
+    out->assign(out_size, '\0');
+    size_t written = 0;
+    error_t err = inflate_raw(stream.data(), stream.size(), &(*out)[0], out_size, &written);
+    out->resize(written);
+    return err;
+}
+
+// Through the window, `chunk_size` bytes per call
+static error_t inflate_stream_string(const std::string& stream, size_t chunk_size, std::string* out) {
+    inflate_stream_t* inflater = inflate_stream_create(stream.data(), stream.size());
+    REQUIRE(inflater != NULL);
+
+    out->clear();
+    std::vector<char> chunk(chunk_size);
+    size_t read;
+    error_t err;
+    while ((err = inflate_stream_read(inflater, chunk.data(), chunk.size(), &read)) == ERROR_SUCCESS && read > 0)
+        out->append(chunk.data(), read);
+
+    inflate_stream_destroy(inflater);
+    return err;
+}
+
+static error_t read_entry(osz_t* archive, int index, std::string* out) {
+    osz_reader_t reader;
+    error_t err = osz_reader_open(&reader, archive, index);
+    if (err != ERROR_SUCCESS)
+        return err;
+
+    out->clear();
+    char chunk[3000];
+    size_t read;
+    while ((err = osz_reader_read(&reader, chunk, sizeof(chunk), &read)) == ERROR_SUCCESS && read > 0)
+        out->append(chunk, read);
+
+    osz_reader_close(&reader);
+    return err;
+}
+
+static const difficulty_t* find_difficulty(const beatmap_t* beatmap, id_t id) {
+    for (size_t i = 0; i < kv_size(beatmap->difficulties); i++)
+        if (kv_A(beatmap->difficulties, i).id == id)
+            return &kv_A(beatmap->difficulties, i);
+    return NULL;
+}
+
+TEST_CASE("CRC-32") {
+    REQUIRE(crc32_update(0, "123456789", 9) == 0xcbf43926);
+    REQUIRE(crc32_update(0, NULL, 0) == 0);
+    REQUIRE(crc32_update(crc32_update(0, "1234", 4), "56789", 5) == 0xcbf43926);
+}
+
+TEST_CASE("Inflating hand-made streams") {
+    std::string out;
+
+    SECTION("stored block") {
+        const std::string stream("\x01\x05\x00\xfa\xff" "hello", 10);
+        REQUIRE(inflate_string(stream, 16, &out) == ERROR_SUCCESS);
+        REQUIRE(out == "hello");
+        REQUIRE(inflate_string(stream, 4, &out) != ERROR_SUCCESS);
+        REQUIRE(inflate_string(stream.substr(0, 8), 16, &out) != ERROR_SUCCESS);
+    }
+
+    SECTION("stored block with a damaged length") {
+        const std::string stream("\x01\x05\x00\xfb\xff" "hello", 10);
+        REQUIRE(inflate_string(stream, 16, &out) != ERROR_SUCCESS);
+    }
+
+    SECTION("fixed Huffman block with a back-reference") {
+        const std::string stream("\x4b\x4c\x4a\x4e\x84\x21\x00", 7);
+        REQUIRE(inflate_string(stream, 16, &out) == ERROR_SUCCESS);
+        REQUIRE(out == "abcabcabcabc");
+        REQUIRE(inflate_string(stream, 11, &out) != ERROR_SUCCESS);
+        REQUIRE(inflate_string(stream.substr(0, 4), 16, &out) != ERROR_SUCCESS);
+    }
+
+    SECTION("back-reference before the start") {
+        // zlib with "hello" as preset dictionary, the raw stream refers back into it
+        const std::string stream("\xcb\x00\x11\x00", 4);
+        REQUIRE(inflate_string(stream, 16, &out) != ERROR_SUCCESS);
+    }
+
+    SECTION("reserved block type") {
+        REQUIRE(inflate_string(std::string("\x07", 1), 16, &out) != ERROR_SUCCESS);
+    }
+
+    SECTION("empty stream") {
+        REQUIRE(inflate_string(std::string(), 16, &out) != ERROR_SUCCESS);
+    }
+}
+
+TEST_CASE("Inflating .osz entries") {
+    osz_t archive;
+    REQUIRE(osz_open(&archive, OSZ_PATH) == ERROR_SUCCESS);
+    REQUIRE(kv_size(archive.entries) == 4);
+
+    // Zip method, then the type of the first DEFLATE block
+    const struct { const char* name; int method; int block_type; } expected[] = {
+        { "Easy.osu",   0, -1 },
+        { "Normal.osu", 8, 0 },
+        { "Hard.osu",   8, 2 },
+        { "Insane.osu", 8, 1 },
+    };
+
+    for (const auto& e : expected) {
+        CAPTURE(e.name);
+        int index = osz_find_entry(&archive, e.name);
+        REQUIRE(index >= 0);
+        const osz_entry_t* entry = &kv_A(archive.entries, index);
+        REQUIRE(entry->method == e.method);
+
+        mapped_file_t contents;
+        REQUIRE(osz_extract(&archive, index, &contents) == ERROR_SUCCESS);
+        const std::string extracted(contents.data, contents.size);
+        mapped_file_unload(&contents);
+        REQUIRE(extracted.size() == entry->size);
+        REQUIRE(crc32_update(0, extracted.data(), extracted.size()) == entry->crc32);
+        REQUIRE(extracted.rfind("osu file format v14", 0) == 0);
+
+        osz_blob_t blob;
+        REQUIRE(osz_get_blob(&archive, index, &blob) == ERROR_SUCCESS);
+        REQUIRE(std::string(blob.data, blob.size) == extracted);
+
+        std::string streamed;
+        REQUIRE(read_entry(&archive, index, &streamed) == ERROR_SUCCESS);
+        REQUIRE(streamed == extracted);
+
+        if (e.method == 0)
+            continue;
+
+        const std::string stream(archive.file.data + get_data_offset(archive.file.data, entry), entry->compressed_size);
+        REQUIRE(((stream[0] >> 1) & 3) == e.block_type);
+
+        std::string out;
+        REQUIRE(inflate_string(stream, entry->size, &out) == ERROR_SUCCESS);
+        REQUIRE(out == extracted);
+        for (size_t chunk_size : { 1, 777, 65536, 200000 }) {
+            CAPTURE(chunk_size);
+            REQUIRE(inflate_stream_string(stream, chunk_size, &out) == ERROR_SUCCESS);
+            REQUIRE(out == extracted);
+        }
+        REQUIRE(inflate_stream_string(stream.substr(0, stream.size() / 2), 4096, &out) != ERROR_SUCCESS);
+
+        REQUIRE(inflate_string(stream, entry->size - 1, &out) != ERROR_SUCCESS);
+        REQUIRE(inflate_string(stream.substr(0, stream.size() / 2), entry->size, &out) != ERROR_SUCCESS);
+    }
+
+    osz_close(&archive);
+}
+
+TEST_CASE("Damaged .osz archives") {
+    namespace fs = std::filesystem;
+    const fs::path path = fs::temp_directory_path() / "cmania_damaged.osz";
+    std::vector<char> data = read_file(OSZ_PATH);
+    REQUIRE(data.size() > 22);
+
+    osz_t archive;
+    REQUIRE(osz_open(&archive, OSZ_PATH) == ERROR_SUCCESS);
+    std::vector<osz_entry_t> entries(archive.entries.a, archive.entries.a + kv_size(archive.entries));
+    osz_close(&archive);
+
+    SECTION("CRC mismatch") {
+        size_t offset = read_u32(data.data() + data.size() - 22 + 16);
+        for (size_t i = 0; i < entries.size(); i++) {
+            REQUIRE(read_u32(data.data() + offset) == 0x02014b50);
+            data[offset + 16] ^= 1;
+            offset += 46 + read_u16(data.data() + offset + 28) + read_u16(data.data() + offset + 30) + read_u16(data.data() + offset + 32);
+        }
+        write_file(path, data);
+
+        REQUIRE(osz_open(&archive, path.string().c_str()) == ERROR_SUCCESS);
+        for (size_t i = 0; i < entries.size(); i++) {
+            CAPTURE(entries[i].name);
+            mapped_file_t contents;
+            REQUIRE(osz_extract(&archive, i, &contents) == ERROR_INVALID_FORMAT);
+            std::string streamed;
+            REQUIRE(read_entry(&archive, i, &streamed) == ERROR_INVALID_FORMAT);
+        }
+        osz_close(&archive);
+    }
+
+    SECTION("corrupt streams") {
+        for (const osz_entry_t& entry : entries)
+            if (entry.method != 0)
+                data[get_data_offset(data.data(), &entry) + entry.compressed_size / 2] ^= 0x55;
+        write_file(path, data);
+
+        REQUIRE(osz_open(&archive, path.string().c_str()) == ERROR_SUCCESS);
+        for (size_t i = 0; i < entries.size(); i++) {
+            CAPTURE(entries[i].name);
+            mapped_file_t contents;
+            error_t err = osz_extract(&archive, i, &contents);
+            if (entries[i].method == 0)
+                mapped_file_unload(&contents);
+            REQUIRE((err == ERROR_SUCCESS) == (entries[i].method == 0));
+            std::string streamed;
+            REQUIRE((read_entry(&archive, i, &streamed) == ERROR_SUCCESS) == (entries[i].method == 0));
+        }
+        osz_close(&archive);
+    }
+
+    SECTION("truncated archive") {
+        for (size_t size : { data.size() - 1, data.size() / 2, (size_t)10 }) {
+            CAPTURE(size);
+            write_file(path, std::vector<char>(data.begin(), data.begin() + size));
+            REQUIRE(osz_open(&archive, path.string().c_str()) != ERROR_SUCCESS);
+        }
+    }
+
+    SECTION("entries past the end") {
+        // Cuts the last entry's data and moves the directory up, the offsets still point past it
+        const osz_entry_t& last = entries.back();
+        size_t cut = get_data_offset(data.data(), &last) + last.compressed_size / 2;
+        size_t directory = read_u32(data.data() + data.size() - 22 + 16);
+        std::vector<char> damaged(data.begin(), data.begin() + cut);
+        damaged.insert(damaged.end(), data.begin() + directory, data.end());
+        size_t moved = cut;
+        for (int i = 0; i < 4; i++)
+            damaged[damaged.size() - 22 + 16 + i] = (char)(moved >> (8 * i));
+        write_file(path, damaged);
+
+        REQUIRE(osz_open(&archive, path.string().c_str()) == ERROR_SUCCESS);
+        int index = osz_find_entry(&archive, last.name);
+        REQUIRE(index >= 0);
+        mapped_file_t contents;
+        REQUIRE(osz_extract(&archive, index, &contents) != ERROR_SUCCESS);
+        osz_close(&archive);
+    }
+
+    fs::remove(path);
+}
+
+TEST_CASE("Loading a beatmap from .osz") {
+    namespace fs = std::filesystem;
+
+    // The same difficulties extracted into a folder, loaded the usual way
+    const fs::path folder = fs::temp_directory_path() / "cmania_osz_extracted";
+    fs::remove_all(folder);
+    fs::create_directories(folder);
+    osz_t archive;
+    REQUIRE(osz_open(&archive, OSZ_PATH) == ERROR_SUCCESS);
+    for (size_t i = 0; i < kv_size(archive.entries); i++) {
+        mapped_file_t contents;
+        REQUIRE(osz_extract(&archive, i, &contents) == ERROR_SUCCESS);
+        write_file(folder / kv_A(archive.entries, i).name, std::vector<char>(contents.data, contents.data + contents.size));
+        mapped_file_unload(&contents);
+    }
+    osz_close(&archive);
+
+    beatmap_t from_osz;
+    beatmap_t from_folder;
+    REQUIRE(beatmap_load(&from_osz, OSZ_PATH) == ERROR_SUCCESS);
+    REQUIRE(beatmap_load(&from_folder, folder.string().c_str()) == ERROR_SUCCESS);
+
+    REQUIRE(from_osz.archive != NULL);
+    REQUIRE(from_osz.id == 900);
+    REQUIRE(std::string(from_osz.title) == "Archive");
+    REQUIRE(kv_size(from_osz.difficulties) == 4);
+    REQUIRE(kv_size(from_folder.difficulties) == 4);
+
+    const struct { id_t id; const char* name; size_t note_count; } expected[] = {
+        { 901, "Easy",   50 },
+        { 902, "Normal", 600 },
+        { 903, "Hard",   5000 },
+        { 904, "Insane", 300 },
+    };
+
+    for (const auto& e : expected) {
+        CAPTURE(e.name);
+        const difficulty_t* a = find_difficulty(&from_osz, e.id);
+        const difficulty_t* b = find_difficulty(&from_folder, e.id);
+        REQUIRE(a != NULL);
+        REQUIRE(b != NULL);
+        REQUIRE(std::string(a->name) == e.name);
+        REQUIRE(std::string(a->audio_filename) == "audio.mp3");
+        REQUIRE(a->CS == 4);
+        REQUIRE(kv_size(a->hitobjects) == e.note_count);
+        REQUIRE(kv_size(a->hitobjects) == kv_size(b->hitobjects));
+        REQUIRE(kv_size(a->timing_points) == 2);
+        REQUIRE(kv_size(a->timing_points) == kv_size(b->timing_points));
+
+        bool is_same = true;
+        for (size_t i = 0; i < kv_size(a->hitobjects); i++) {
+            const hitobject_t* x = &kv_A(a->hitobjects, i);
+            const hitobject_t* y = &kv_A(b->hitobjects, i);
+            is_same = is_same && x->start_time == y->start_time && x->end_time == y->end_time && x->column == y->column;
+        }
+        for (size_t i = 0; i < kv_size(a->timing_points); i++) {
+            const timing_point_t* x = &kv_A(a->timing_points, i);
+            const timing_point_t* y = &kv_A(b->timing_points, i);
+            is_same = is_same && x->time == y->time && x->BPM == y->BPM && x->SV == y->SV;
+        }
+        REQUIRE(is_same);
+    }
+
+    beatmap_destroy(&from_osz);
+    beatmap_destroy(&from_folder);
+    fs::remove_all(folder);
+}
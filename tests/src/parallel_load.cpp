@@ -0,0 +1,68 @@
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+#include "synthetic_map.hpp"
+
+
+// Everything the parser produces, in order
+static std::string describe(const beatmap_t* beatmap) {
+    std::string text = std::to_string(beatmap->id) + " " + beatmap->title + "\n";
+    for (size_t i = 0; i < kv_size(beatmap->difficulties); i++) {
+        const difficulty_t* d = &kv_A(beatmap->difficulties, i);
+        text += std::string(d->file_name) + " " + std::to_string(d->id) + " " + d->name + " " + std::to_string(d->CS) + "\n";
+        for (size_t j = 0; j < kv_size(d->timing_points); j++) {
+            const timing_point_t* tm = &kv_A(d->timing_points, j);
+            text += std::to_string(tm->time) + " " + std::to_string(tm->BPM) + " " + std::to_string(tm->SV) + "\n";
+        }
+        for (size_t j = 0; j < kv_size(d->hitobjects); j++) {
+            const hitobject_t* ho = &kv_A(d->hitobjects, j);
+            text += std::to_string(ho->start_time) + " " + std::to_string(ho->end_time) + " " + std::to_string(ho->column) + "\n";
+        }
+    }
+    return text;
+}
+
+TEST_CASE("Parallel difficulty parsing") {
+    namespace fs = std::filesystem;
+    const fs::path root = fs::temp_directory_path() / "cmania_parallel_load";
+    fs::remove_all(root);
+    fs::create_directories(root);
+
+    // Sizes out of name order, so the largest-first dispatch reorders the jobs
+    for (int i = 0; i < 12; i++) {
+        synthetic_map_t map;
+        map.key_count = 4 + i % 4;
+        map.note_count = 200 + (i * 7 % 12) * 300;
+        map.uninherited_count = 3;
+        map.inherited_count = 20 + i;
+        std::string text = make_synthetic_osu(map);
+        if (i == 5)
+            text.replace(text.find("Mode: 3"), 7, "Mode: 0");  // rejected, leaves a gap
+        std::ofstream(root / ("d" + std::to_string(i / 10) + std::to_string(i % 10) + ".osu"), std::ios::binary) << text;
+    }
+
+    // Results must come from the parse, not from files compiled by an earlier load
+    cache_set_enabled(false);
+
+    beatmap_t serial;
+    beatmap_set_worker_count(1);
+    REQUIRE(beatmap_load(&serial, root.string().c_str()) == ERROR_SUCCESS);
+    REQUIRE(kv_size(serial.difficulties) == 11);
+    const std::string expected = describe(&serial);
+
+    for (int worker_count : { 2, 4, 16 }) {
+        beatmap_t parallel;
+        beatmap_set_worker_count(worker_count);
+        REQUIRE(beatmap_load(&parallel, root.string().c_str()) == ERROR_SUCCESS);
+        REQUIRE(describe(&parallel) == expected);
+        beatmap_destroy(&parallel);
+    }
+
+    beatmap_set_worker_count(0);
+    beatmap_destroy(&serial);
+    fs::remove_all(root);
+}
@@ -0,0 +1,66 @@
+#include <cmath>
+#include <vector>
+#include <random>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "cmania.hpp"
+
+
+static std::vector<float> make_positions(int count) {
+    std::mt19937 random(3);
+    std::vector<float> positions;
+    float position = -200;
+    for (int i = 0; i < count; i++) {
+        position += std::uniform_real_distribution<float>(0, 40)(random);
+        positions.push_back(position);
+    }
+    return positions;
+}
+
+// What the kernel replaces
+static void project_scalar(const float* positions, int count, float scroll, float scale, float origin, float* ys) {
+    for (int i = 0; i < count; i++)
+        ys[i] = (positions[i] - scroll) * scale + origin;
+}
+
+TEST_CASE("Event projection") {
+    std::vector<float> positions = make_positions(100);
+
+    // Every length and start, so each vector width and tail is covered
+    for (int first = 0; first < 9; first++) {
+        for (int count = 0; first + count <= (int)positions.size(); count++) {
+            std::vector<float> expected(count + 1, -1.0f);
+            std::vector<float> ys(count + 1, -1.0f);
+            project_scalar(positions.data() + first, count, 1234.5f, -0.75f, 900.0f, expected.data());
+            playfield_project_events(positions.data() + first, count, 1234.5f, -0.75f, 900.0f, ys.data());
+
+            bool is_same = true;
+            for (int i = 0; i < count; i++)
+                is_same = is_same && std::abs(ys[i] - expected[i]) <= 1e-6f * std::abs(expected[i]) + 1e-4f;
+            REQUIRE(is_same);
+            REQUIRE(ys[count] == -1.0f);
+        }
+    }
+}
+
+TEST_CASE("Event projection benchmark", "[.][benchmark]") {
+    // A dense 7K screen holds a few hundred events, a whole column of a long map a few thousand
+    for (int count : { 256, 4096 }) {
+        std::vector<float> positions = make_positions(count);
+        std::vector<float> ys(count);
+        volatile float scroll = 5000.0f;
+
+        BENCHMARK("scalar loop " + std::to_string(count)) {
+            project_scalar(positions.data(), count, scroll, -0.75f, 900.0f, ys.data());
+            return ys[count - 1];
+        };
+
+        BENCHMARK("playfield_project_events " + std::to_string(count)) {
+            playfield_project_events(positions.data(), count, scroll, -0.75f, 900.0f, ys.data());
+            return ys[count - 1];
+        };
+    }
+}
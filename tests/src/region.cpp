@@ -0,0 +1,194 @@
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+
+
+TEST_CASE("Region vectors") {
+    region_t* region = region_create();
+    REQUIRE(region != NULL);
+
+    kvec_t(int) v;
+    kv_init(v);
+    for (int i = 0; i < 100000; i++)
+        region_kv_push(int, region, v, i);
+
+    REQUIRE(kv_size(v) == 100000);
+    bool is_intact = true;
+    for (int i = 0; i < 100000; i++)
+        is_intact = is_intact && kv_A(v, i) == i;
+    REQUIRE(is_intact);
+
+    // No frees needed, the vector's memory goes away with the region
+    region_destroy(region);
+    region_destroy(NULL);
+}
+
+TEST_CASE("Region fallback to the heap") {
+    kvec_t(int) v;
+    kv_init(v);
+    for (int i = 0; i < 1000; i++)
+        region_kv_push(int, NULL, v, i);
+
+    REQUIRE(kv_size(v) == 1000);
+    REQUIRE(kv_A(v, 999) == 999);
+    region_kv_destroy(NULL, v);
+}
+
+TEST_CASE("Region vector push reports running out of memory") {
+    kvec_t(int) v;
+    kv_init(v);
+    REQUIRE(region_kv_push(int, NULL, v, 1));
+    int* a = v.a;
+
+    // Doubling would overflow the byte count, so nothing is allocated
+    v.n = v.m = SIZE_MAX / 4;
+    REQUIRE(!region_kv_push(int, NULL, v, 2));
+    REQUIRE(v.a == a);
+    REQUIRE(v.n == SIZE_MAX / 4);
+
+    region_kv_destroy(NULL, v);
+}
+
+TEST_CASE("Playfield reuses the difficulty region") {
+    difficulty_t d;
+    memset(&d, 0, sizeof(d));
+    d.region = region_create();
+    d.CS = 4;
+    for (int i = 0; i < 1000; i++) {
+        hitobject_t ho;
+        memset(&ho, 0, sizeof(ho));
+        ho.column = i % 4;
+        ho.start_time = i * 100;
+        region_kv_push(hitobject_t, d.region, d.hitobjects, ho);
+    }
+    timing_point_t tm = { 0, 120.0f, 1.0f };
+    region_kv_push(timing_point_t, d.region, d.timing_points, tm);
+
+    for (int i = 0; i < 3; i++) {
+        playfield_t playfield;
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE(playfield.region == d.region);
+        REQUIRE(kv_size(playfield.columns) == 4);
+        REQUIRE(kv_size(kv_A(playfield.columns, 0).positions) == 250);
+        playfield_destroy(&playfield);
+        REQUIRE(kv_size(playfield.columns) == 0);
+    }
+
+    region_destroy(d.region);
+}
+
+static void push_hitobjects(difficulty_t* d, int count, int column_count) {
+    for (int i = 0; i < count; i++) {
+        hitobject_t ho = { i * 100, (i % 4 == 0) ? (i * 100 + 50) : (0), i % column_count };
+        region_kv_push(hitobject_t, d->region, d->hitobjects, ho);
+    }
+    timing_point_t tm = { 0, 120.0f, 1.0f };
+    region_kv_push(timing_point_t, d->region, d->timing_points, tm);
+    d->CS = column_count;
+}
+
+TEST_CASE("Playfield rebuild reuses its buffers") {
+    difficulty_t d, small, other;
+    memset(&d, 0, sizeof(d));
+    memset(&small, 0, sizeof(small));
+    memset(&other, 0, sizeof(other));
+    d.region = small.region = region_create();
+    other.region = region_create();
+    push_hitobjects(&d, 1000, 4);
+    push_hitobjects(&small, 300, 3);
+    push_hitobjects(&other, 100, 4);
+
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+
+    std::vector<std::vector<float>> positions;
+    std::vector<const void*> buffers = { playfield.columns.a, playfield.speed_mods.a };
+    for (size_t i = 0; i < kv_size(playfield.columns); i++) {
+        playfield_column_t* pc = &kv_A(playfield.columns, i);
+        positions.push_back(std::vector<float>(pc->positions.a, pc->positions.a + kv_size(pc->positions)));
+        buffers.push_back(pc->positions.a);
+        buffers.push_back(pc->types.a);
+    }
+    auto get_buffers = [&]() {
+        std::vector<const void*> current = { playfield.columns.a, playfield.speed_mods.a };
+        for (size_t i = 0; i < kv_max(playfield.columns); i++) {
+            current.push_back(kv_A(playfield.columns, i).positions.a);
+            current.push_back(kv_A(playfield.columns, i).types.a);
+        }
+        return current;
+    };
+
+    SECTION("retrying") {
+        bool is_same = true;
+        for (int i = 0; i < 200; i++) {
+            REQUIRE(playfield_rebuild(&playfield, &d) == ERROR_SUCCESS);
+            is_same = is_same && get_buffers() == buffers;
+            for (size_t k = 0; k < kv_size(playfield.columns); k++) {
+                playfield_column_t* pc = &kv_A(playfield.columns, k);
+                is_same = is_same && std::vector<float>(pc->positions.a, pc->positions.a + kv_size(pc->positions)) == positions[k];
+            }
+        }
+        REQUIRE(is_same);
+    }
+
+    SECTION("switching difficulties") {
+        REQUIRE(playfield_rebuild(&playfield, &small) == ERROR_SUCCESS);
+        REQUIRE(kv_size(playfield.columns) == 3);
+        REQUIRE(kv_size(kv_A(playfield.columns, 0).positions) == 125);
+        REQUIRE(get_buffers() == buffers);
+
+        REQUIRE(playfield_rebuild(&playfield, &d) == ERROR_SUCCESS);
+        REQUIRE(kv_size(playfield.columns) == 4);
+        REQUIRE(kv_size(kv_A(playfield.columns, 3).positions) == 250);
+        REQUIRE(get_buffers() == buffers);
+
+        // Another beatmap's region, nothing can be kept
+        REQUIRE(playfield_rebuild(&playfield, &other) == ERROR_SUCCESS);
+        REQUIRE(playfield.region == other.region);
+        REQUIRE(kv_size(kv_A(playfield.columns, 0).positions) == 50);
+    }
+
+    SECTION("reset") {
+        playfield_reset(&playfield);
+        REQUIRE(kv_size(playfield.columns) == 0);
+        REQUIRE(kv_size(playfield.speed_mods) == 0);
+        REQUIRE(get_buffers() == buffers);
+    }
+
+    playfield_destroy(&playfield);
+    region_destroy(d.region);
+    region_destroy(other.region);
+}
+
+TEST_CASE("Playfield rebuild outlives the previous beatmap") {
+    beatmap_t a, b;
+    REQUIRE(beatmap_load(&a, TESTS_ASSETS_DIR "/set.osz") == ERROR_SUCCESS);
+    REQUIRE(beatmap_load(&b, TESTS_ASSETS_DIR "/set.osz") == ERROR_SUCCESS);
+    difficulty_t* first = &kv_A(a.difficulties, 0);
+    difficulty_t* second = &kv_A(b.difficulties, kv_size(b.difficulties) - 1);
+    REQUIRE(first->region != second->region);
+
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(first, &playfield) == ERROR_SUCCESS);
+
+    // The old buffers went away with the region, the rebuild must not touch them
+    beatmap_destroy(&a);
+    REQUIRE(playfield_rebuild(&playfield, second) == ERROR_SUCCESS);
+    REQUIRE(playfield.region == second->region);
+    REQUIRE(kv_size(playfield.columns) == (size_t)second->CS);
+
+    playfield_t expected;
+    REQUIRE(playfield_create_from(second, &expected) == ERROR_SUCCESS);
+    for (size_t i = 0; i < kv_size(playfield.columns); i++) {
+        playfield_column_t* pc = &kv_A(playfield.columns, i);
+        playfield_column_t* expected_pc = &kv_A(expected.columns, i);
+        REQUIRE(kv_size(pc->positions) == kv_size(expected_pc->positions));
+        REQUIRE(memcmp(pc->positions.a, expected_pc->positions.a, kv_size(pc->positions) * sizeof(float)) == 0);
+    }
+
+    playfield_destroy(&expected);
+    playfield_destroy(&playfield);
+    beatmap_destroy(&b);
+}
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <vector>
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "cmania.hpp"
+
+
+using Catch::Matchers::WithinAbs;
+
+// 120 BPM at SV 1 scrolls 200 opx per second
+static difficulty_t make_difficulty(const std::vector<timing_point_t>& tms) {
+    difficulty_t d;
+    memset(&d, 0, sizeof(d));
+    d.CS = 4;
+    for (const timing_point_t& tm : tms)
+        kv_push(timing_point_t, d.timing_points, tm);
+    return d;
+}
+
+// Walks every segment, what the lookup saves a renderer from doing
+static double get_position_linear(const std::vector<timing_point_t>& tms, ms_t time) {
+    double position = tms[0].time / 1000.0 * (100 * tms[0].SV * tms[0].BPM / 60.0);
+    size_t i = 0;
+    for (; i + 1 < tms.size() && tms[i + 1].time <= time; i++)
+        position += (tms[i + 1].time - tms[i].time) / 1000.0 * (100 * tms[i].SV * tms[i].BPM / 60.0);
+    return position + (time - tms[i].time) / 1000.0 * (100 * tms[i].SV * tms[i].BPM / 60.0);
+}
+
+TEST_CASE("Scroll position") {
+    playfield_t playfield;
+
+    SECTION("constant speed") {
+        difficulty_t d = make_difficulty({ { 0, 120, 1 } });
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE_THAT(playfield_get_position(&playfield, 0), WithinAbs(0, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 1000), WithinAbs(200, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, -500), WithinAbs(-100, 1e-3));
+        playfield_destroy(&playfield);
+        kv_destroy(d.timing_points);
+    }
+
+    SECTION("first timing point away from 0") {
+        difficulty_t d = make_difficulty({ { -1000, 120, 1 }, { 2000, 120, 2 } });
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE_THAT(playfield_get_position(&playfield, -1000), WithinAbs(-200, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 0), WithinAbs(0, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 3000), WithinAbs(800, 1e-3));
+        playfield_destroy(&playfield);
+        kv_destroy(d.timing_points);
+
+        d = make_difficulty({ { 2000, 120, 1 } });
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE_THAT(playfield_get_position(&playfield, 0), WithinAbs(0, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 2000), WithinAbs(400, 1e-3));
+        playfield_destroy(&playfield);
+        kv_destroy(d.timing_points);
+    }
+
+    SECTION("zero and negative SV") {
+        difficulty_t d = make_difficulty({ { 0, 120, 1 }, { 1000, 120, 0 }, { 2000, 120, -1 }, { 3000, 120, 1 } });
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE_THAT(playfield_get_position(&playfield, 1500), WithinAbs(200, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 2000), WithinAbs(200, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 2500), WithinAbs(100, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 3000), WithinAbs(0, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 4000), WithinAbs(200, 1e-3));
+        playfield_destroy(&playfield);
+        kv_destroy(d.timing_points);
+    }
+
+    SECTION("broken timing point") {
+        difficulty_t d = make_difficulty({ { 0, 120, 1 }, { 1000, INFINITY, 1 }, { 2000, 120, 1 } });
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        REQUIRE_THAT(playfield_get_position(&playfield, 1500), WithinAbs(200, 1e-3));
+        REQUIRE_THAT(playfield_get_position(&playfield, 3000), WithinAbs(400, 1e-3));
+        playfield_destroy(&playfield);
+        kv_destroy(d.timing_points);
+    }
+
+    SECTION("no timing points") {
+        difficulty_t d = make_difficulty({});
+        REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+        playfield_cursor_t cursor = {0};
+        REQUIRE(playfield_get_position(&playfield, 1000) == 0);
+        REQUIRE(playfield_seek_position(&playfield, &cursor, 1000) == 0);
+        playfield_destroy(&playfield);
+    }
+}
+
+TEST_CASE("Scroll position cursor") {
+    std::mt19937 random(17);
+    std::vector<timing_point_t> tms;
+    ms_t time = -300;
+    for (int i = 0; i < 2000; i++) {
+        tms.push_back({ time, (i % 10 == 0) ? (180.0f) : (tms.back().BPM), (float)(random() % 300) / 100.0f - 0.5f });
+        time += (i % 7 == 0) ? (0) : ((ms_t)(random() % 400));  // some share a time
+    }
+
+    difficulty_t d = make_difficulty(tms);
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+
+    // Positions reach a few hundred thousand opx, float keeps about 0.05 of them
+    auto require_position = [&](ms_t t, float position) {
+        double expected = get_position_linear(tms, t);
+        REQUIRE_THAT(position, WithinAbs(expected, 1e-6 * std::abs(expected) + 1e-2));
+    };
+
+    SECTION("playback") {
+        playfield_cursor_t cursor = {0};
+        for (ms_t t = -1000; t < time + 1000; t += 16)
+            require_position(t, playfield_seek_position(&playfield, &cursor, t));
+    }
+
+    SECTION("seeking") {
+        playfield_cursor_t cursor = {0};
+        for (int i = 0; i < 5000; i++) {
+            ms_t t = (ms_t)(random() % (time + 2000)) - 1000;
+            require_position(t, playfield_seek_position(&playfield, &cursor, t));
+            require_position(t, playfield_get_position(&playfield, t));
+        }
+    }
+
+    playfield_destroy(&playfield);
+    kv_destroy(d.timing_points);
+}
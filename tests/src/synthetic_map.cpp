@@ -0,0 +1,102 @@
+#include <cmath>
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+#include "synthetic_map.hpp"
+
+
+namespace fs = std::filesystem;
+
+// True for `numerator` out of every `denominator` consecutive `i`, starting with 0
+static bool is_every(long long i, long long numerator, long long denominator) {
+    return (i == 0) ? (numerator > 0) : (i * numerator / denominator != (i - 1) * numerator / denominator);
+}
+
+std::string make_synthetic_osu(const synthetic_map_t& map) {
+    std::string text =
+        "osu file format v14\n\n[General]\nAudioFilename: audio.mp3\nPreviewTime: 1000\nMode: 3\n\n"
+        "[Metadata]\nTitle:Synthetic\nVersion:" + std::to_string(map.key_count) + "K " + std::to_string(map.note_count) + "\n"
+        "BeatmapID:1\nBeatmapSetID:1\n\n"
+        "[Difficulty]\nHPDrainRate:8\nCircleSize:" + std::to_string(map.key_count) + "\nOverallDifficulty:8\nSliderMultiplier:1.4\n\n"
+        "[TimingPoints]\n";
+
+    const long long length = (long long)map.note_count * map.note_spacing_ms;
+    const int timing_point_count = map.uninherited_count + map.inherited_count;
+    for (int i = 0; i < timing_point_count; i++) {
+        std::string time = std::to_string(length * i / timing_point_count);
+        if (is_every(i, map.uninherited_count, timing_point_count))
+            text += time + ",333.333333333333,4,2,1,60,1,0\n";
+        else
+            text += time + ",-" + std::to_string(25 + i % 50) + ",4,2,1,60,0,0\n";  // never -100, SV always changes
+    }
+
+    text += "\n[HitObjects]\n";
+    const long long hold_millionths = std::llround(map.hold_ratio * 1e6);
+    for (int i = 0; i < map.note_count; i++) {
+        // The middle of the column, osu!mania maps x back with floor(x * keys / 512)
+        int column = i % map.key_count;
+        std::string x = std::to_string((512 * column + 256) / map.key_count);
+        long long time = (long long)i * map.note_spacing_ms;
+
+        if (is_every(i, hold_millionths, 1000000))
+            text += x + ",192," + std::to_string(time) + ",128,0," + std::to_string(time + map.hold_length_ms) + ":0:0:0:0:\n";
+        else
+            text += x + ",192," + std::to_string(time) + ",1,0,0:0:0:0:\n";
+    }
+    return text;
+}
+
+fs::path write_synthetic_set(const char* name, const synthetic_map_t& map) {
+    fs::path dir = fs::temp_directory_path() / "cmania_synthetic" / name;
+    fs::create_directories(dir);
+    std::ofstream(dir / "synthetic.osu", std::ios::binary) << make_synthetic_osu(map);
+    return dir;
+}
+
+TEST_CASE("Synthetic beatmaps") {
+    // Every combination is a new file, compiled copies would only pile up
+    cache_set_enabled(false);
+
+    fs::path dir;
+    for (int key_count : { 1, 4, 7, 10, 18 }) {
+        for (double hold_ratio : { 0.0, 0.3, 1.0 }) {
+            synthetic_map_t map;
+            map.key_count = key_count;
+            map.note_count = 5000;
+            map.hold_ratio = hold_ratio;
+            map.uninherited_count = 7;
+            map.inherited_count = 93;
+
+            beatmap_t beatmap;
+            dir = write_synthetic_set("generator", map);
+            const std::string path = dir.string();
+            REQUIRE(beatmap_load(&beatmap, path.c_str()) == ERROR_SUCCESS);
+            REQUIRE(kv_size(beatmap.difficulties) == 1);
+
+            difficulty_t* d = &kv_A(beatmap.difficulties, 0);
+            REQUIRE((int)d->CS == key_count);
+            REQUIRE((int)kv_size(d->timing_points) == 100);
+            REQUIRE((int)kv_size(d->hitobjects) == map.note_count);
+
+            int holds = 0;
+            bool is_column_right = true;
+            for (int i = 0; i < map.note_count; i++) {
+                const hitobject_t* ho = &kv_A(d->hitobjects, i);
+                holds += ho->end_time != 0;
+                is_column_right = is_column_right && ho->column == i % key_count;
+            }
+            REQUIRE(is_column_right);
+            REQUIRE(std::abs(holds - map.note_count * hold_ratio) <= 1);
+
+            int uninherited = 0;
+            for (int i = 0; i < (int)kv_size(d->timing_points); i++)
+                uninherited += kv_A(d->timing_points, i).SV == d->SV;
+            REQUIRE(uninherited == map.uninherited_count);
+
+            beatmap_destroy(&beatmap);
+        }
+    }
+    fs::remove_all(dir);
+}
@@ -0,0 +1,26 @@
+#ifndef TESTS_SYNTHETIC_MAP_HPP
+#define TESTS_SYNTHETIC_MAP_HPP
+
+#include <string>
+#include <filesystem>
+
+
+// A valid osu!mania difficulty of any size. Notes cycle through the columns at a
+// fixed spacing and the timing points are spread evenly over the notes, the
+// first one always uninherited. The same options always give the same file.
+struct synthetic_map_t {
+    int     key_count           = 7;  // 1 to 18
+    int     note_count          = 40000;
+    double  hold_ratio          = 0.25;  // 0 to 1
+    int     uninherited_count   = 1000;  // at least 1
+    int     inherited_count     = 1000;
+    int     note_spacing_ms     = 25;
+    int     hold_length_ms      = 400;
+};
+
+std::string             make_synthetic_osu(const synthetic_map_t& map);
+// Writes a set folder with one .osu below the temp directory and returns it
+std::filesystem::path   write_synthetic_set(const char* name, const synthetic_map_t& map);
+
+
+#endif
@@ -0,0 +1,115 @@
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "cmania.hpp"
+
+
+// Timing points every 100ms with an inherited point between each pair, like SV-heavy maps
+static difficulty_t make_difficulty(int timing_point_count) {
+    difficulty_t d;
+    memset(&d, 0, sizeof(d));
+    for (int i = 0; i < timing_point_count; i++) {
+        timing_point_t tm = { i * 100, 120.0f, (i % 2) ? 0.5f : 1.0f };
+        kv_push(timing_point_t, d.timing_points, tm);
+    }
+    return d;
+}
+
+static int find_linear(difficulty_t* d, ms_t time) {
+    int i = 0;
+    while (i < (int)kv_size(d->timing_points) && kv_A(d->timing_points, i).time <= time)
+        i++;
+    return i - 1;
+}
+
+TEST_CASE("Timing point lookup") {
+    difficulty_t d = make_difficulty(100);
+
+    REQUIRE(difficulty_get_timing_point_index_for_time(&d, -1) == -1);
+    REQUIRE(difficulty_get_timing_point_for_time(&d, -1) == NULL);
+    REQUIRE(difficulty_get_timing_point_index_for_time(&d, 0) == 0);
+    REQUIRE(difficulty_get_timing_point_index_for_time(&d, 150) == 1);
+    REQUIRE(difficulty_get_timing_point_index_for_time(&d, 1000000) == 99);
+
+    for (int i = -10; i < 1100; i++) {
+        ms_t time = i * 10;
+        REQUIRE(difficulty_get_timing_point_index_for_time(&d, time) == find_linear(&d, time));
+    }
+
+    kv_destroy(d.timing_points);
+}
+
+TEST_CASE("Timing point cursor") {
+    difficulty_t d = make_difficulty(100);
+    timing_point_cursor_t cursor = {0};
+
+    SECTION("forward sweep") {
+        for (int i = -10; i < 1100; i++) {
+            ms_t time = i * 10;
+            REQUIRE(difficulty_seek_timing_point(&d, &cursor, time) == find_linear(&d, time));
+        }
+    }
+
+    SECTION("going back") {
+        REQUIRE(difficulty_seek_timing_point(&d, &cursor, 5050) == 50);
+        REQUIRE(difficulty_seek_timing_point(&d, &cursor, 2050) == 20);
+        REQUIRE(difficulty_seek_timing_point(&d, &cursor, -1) == -1);
+        REQUIRE(difficulty_seek_timing_point(&d, &cursor, 9950) == 99);
+    }
+
+    SECTION("no timing points") {
+        difficulty_t empty;
+        memset(&empty, 0, sizeof(empty));
+        REQUIRE(difficulty_seek_timing_point(&empty, &cursor, 1000) == -1);
+        REQUIRE(difficulty_get_timing_point_index_for_time(&empty, 1000) == -1);
+    }
+
+    kv_destroy(d.timing_points);
+}
+
+TEST_CASE("Timing point lookup benchmark", "[.][benchmark]") {
+    difficulty_t d = make_difficulty(10000);
+
+    // One hit object every 10ms over the whole map, as the parser sees them
+    std::vector<ms_t> times;
+    for (int i = 0; i < 100000; i++)
+        times.push_back(i * 10);
+
+    BENCHMARK("linear scan") {
+        long sum = 0;
+        for (size_t i = 0; i < times.size(); i += 100)  // 1% of the lookups, divide by 100 when comparing
+            sum += find_linear(&d, times[i]);
+        return sum;
+    };
+
+    BENCHMARK("binary search") {
+        long sum = 0;
+        for (ms_t time : times)
+            sum += difficulty_get_timing_point_index_for_time(&d, time);
+        return sum;
+    };
+
+    BENCHMARK("cursor") {
+        long sum = 0;
+        timing_point_cursor_t cursor = {0};
+        for (ms_t time : times)
+            sum += difficulty_seek_timing_point(&d, &cursor, time);
+        return sum;
+    };
+
+    kv_destroy(d.timing_points);
+}
+
+TEST_CASE("Millisecond conversion") {
+    REQUIRE(ms_to_seconds(1500) == 1.5f);
+    REQUIRE(seconds_to_ms(ms_to_seconds(-250)) == -250);
+
+    // Float seconds still resolve single milliseconds two hours in
+    for (ms_t ms = 7200000; ms < 7201000; ms++)
+        REQUIRE(seconds_to_ms(ms_to_seconds(ms)) == ms);
+
+    // Differences are taken in milliseconds first, so they stay exact anywhere
+    REQUIRE(ms_to_seconds(36000001 - 36000000) == 0.001f);
+}
@@ -0,0 +1,130 @@
+#include <vector>
+#include <random>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "cmania.hpp"
+#include "synthetic_map.hpp"
+
+
+// Everything visible has to be in the window, with both ends of its hold
+static void require_window(playfield_t* playfield, int column, const playfield_window_t& window, float y0, float y1) {
+    playfield_column_t* pc = &kv_A(playfield->columns, column);
+    const int count = kv_size(pc->positions);
+    REQUIRE(0 <= window.first);
+    REQUIRE(window.first <= window.last);
+    REQUIRE(window.last <= count);
+
+    bool is_complete = true;
+    bool is_tight = true;
+    for (int i = 0; i < count; i++) {
+        const playfield_event_t pe = playfield_get_event(pc, i);
+        bool is_inside = window.first <= i && i < window.last;
+        bool is_visible = y0 <= pe.position && pe.position <= y1;
+
+        if (pe.type == PLAYFIELD_EVENT_HOLD_BEGIN) {
+            float a = pe.position;
+            float b = kv_A(pc->positions, i + 1);
+            bool is_hold_visible = std::min(a, b) <= y1 && std::max(a, b) >= y0;
+            bool is_pair_inside = window.first <= i && i + 1 < window.last;
+            is_complete = is_complete && (!is_hold_visible || is_pair_inside);
+            is_tight = is_tight && (is_hold_visible || !is_inside);
+        }
+        else if (pe.type == PLAYFIELD_EVENT_NOTE) {
+            is_complete = is_complete && (!is_visible || is_inside);
+            is_tight = is_tight && (is_visible || !is_inside);
+        }
+    }
+    REQUIRE(is_complete);
+    if (kv_size(pc->highest) == 0)
+        REQUIRE(is_tight);
+}
+
+static void sweep(playfield_t* playfield, float y0, float y1, float step, float height) {
+    std::vector<playfield_window_t> windows(kv_size(playfield->columns), playfield_window_t{0, 0});
+    for (float y = y0; y < y1; y += step)
+        for (int k = 0; k < (int)kv_size(playfield->columns); k++) {
+            playfield_query_window(playfield, k, &windows[k], y, y + height);
+            require_window(playfield, k, windows[k], y, y + height);
+        }
+}
+
+TEST_CASE("Visible window") {
+    synthetic_map_t map;
+    map.key_count = 4;
+    map.note_count = 4000;
+    map.uninherited_count = 5;
+    map.inherited_count = 45;
+    map.note_spacing_ms = 30;
+    map.hold_length_ms = 100;
+
+    beatmap_t beatmap;
+    const std::filesystem::path dir = write_synthetic_set("visible_window", map);
+    const std::string path = dir.string();
+    REQUIRE(beatmap_load(&beatmap, path.c_str()) == ERROR_SUCCESS);
+    difficulty_t* d = &kv_A(beatmap.difficulties, 0);
+
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(d, &playfield) == ERROR_SUCCESS);
+    REQUIRE(kv_size(kv_A(playfield.columns, 0).highest) == 0);
+    const float end = playfield_get_position(&playfield, map.note_count * map.note_spacing_ms);
+
+    SECTION("playback") {
+        sweep(&playfield, -500, end + 500, 7.5f, 480);
+    }
+
+    SECTION("seeking and scrolling back") {
+        std::mt19937 random(5);
+        std::vector<playfield_window_t> windows(kv_size(playfield.columns), playfield_window_t{0, 0});
+        for (int i = 0; i < 2000; i++) {
+            float y = std::uniform_real_distribution<float>(-500, end + 500)(random);
+            float height = (i % 2) ? (480.0f) : (5.0f);
+            int k = i % kv_size(playfield.columns);
+            playfield_query_window(&playfield, k, &windows[k], y, y + height);
+            require_window(&playfield, k, windows[k], y, y + height);
+        }
+    }
+
+    SECTION("holds longer than the window") {
+        playfield_window_t window = {0, 0};
+        playfield_column_t* pc = &kv_A(playfield.columns, 0);
+        for (int i = 0; i < (int)kv_size(pc->positions); i++) {
+            if (playfield_get_event_type(pc, i) != PLAYFIELD_EVENT_HOLD_BEGIN)
+                continue;
+            float y = (kv_A(pc->positions, i) + kv_A(pc->positions, i + 1)) / 2;
+            playfield_query_window(&playfield, 0, &window, y, y);
+            REQUIRE(window.first == i);
+            REQUIRE(window.last == i + 2);
+        }
+    }
+
+    playfield_destroy(&playfield);
+    beatmap_destroy(&beatmap);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Visible window with scrolling back") {
+    difficulty_t d;
+    memset(&d, 0, sizeof(d));
+    d.CS = 2;
+
+    // Scrolls backwards between 2s and 3s
+    timing_point_t tms[] = { { 0, 120, 1 }, { 2000, 120, -1 }, { 3000, 120, 1 } };
+    for (const timing_point_t& tm : tms)
+        kv_push(timing_point_t, d.timing_points, tm);
+    for (int i = 0; i < 200; i++) {
+        hitobject_t ho = { i * 25, (i % 5 == 0) ? (i * 25 + 300) : (0), i % 2 };
+        kv_push(hitobject_t, d.hitobjects, ho);
+    }
+
+    playfield_t playfield;
+    REQUIRE(playfield_create_from(&d, &playfield) == ERROR_SUCCESS);
+    REQUIRE(kv_size(kv_A(playfield.columns, 0).highest) > 0);
+    sweep(&playfield, -100, 1100, 3, 50);
+
+    playfield_destroy(&playfield);
+    region_free(NULL, d.hitobject_arrays.memory);
+    kv_destroy(d.hitobjects);
+    kv_destroy(d.timing_points);
+}
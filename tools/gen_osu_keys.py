@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Generates src/osu_keys.h and src/osu_keys.c, the perfect hash tables used to
+dispatch .osu section names and keys.
+
+To handle a new key add it to KEYS, rerun `python3 tools/gen_osu_keys.py` from the
+repository root and commit the regenerated files.
+"""
+
+import itertools
+import random
+import sys
+from pathlib import Path
+
+
+# (name in the .osu file, enum suffix)
+SECTIONS = [
+    ("General",         "GENERAL"),
+    ("Editor",          "EDITOR"),
+    ("Metadata",        "METADATA"),
+    ("Difficulty",      "DIFFICULTY"),
+    ("Events",          "EVENTS"),
+    ("TimingPoints",    "TIMING_POINTS"),
+    ("Colours",         "COLOURS"),
+    ("HitObjects",      "HITOBJECTS"),
+]
+
+KEYS = [
+    # [General]
+    ("AudioFilename",               "AUDIO_FILENAME"),
+    ("AudioLeadIn",                 "AUDIO_LEAD_IN"),
+    ("PreviewTime",                 "PREVIEW_TIME"),
+    ("Countdown",                   "COUNTDOWN"),
+    ("SampleSet",                   "SAMPLE_SET"),
+    ("StackLeniency",               "STACK_LENIENCY"),
+    ("Mode",                        "MODE"),
+    ("LetterboxInBreaks",           "LETTERBOX_IN_BREAKS"),
+    ("SpecialStyle",                "SPECIAL_STYLE"),
+    ("WidescreenStoryboard",        "WIDESCREEN_STORYBOARD"),
+    ("SamplesMatchPlaybackRate",    "SAMPLES_MATCH_PLAYBACK_RATE"),
+    # [Metadata]
+    ("Title",                       "TITLE"),
+    ("TitleUnicode",                "TITLE_UNICODE"),
+    ("Artist",                      "ARTIST"),
+    ("ArtistUnicode",               "ARTIST_UNICODE"),
+    ("Creator",                     "CREATOR"),
+    ("Version",                     "VERSION"),
+    ("Source",                      "SOURCE"),
+    ("Tags",                        "TAGS"),
+    ("BeatmapID",                   "BEATMAP_ID"),
+    ("BeatmapSetID",                "BEATMAPSET_ID"),
+    # [Difficulty]
+    ("HPDrainRate",                 "HP"),
+    ("CircleSize",                  "CS"),
+    ("OverallDifficulty",           "OD"),
+    ("ApproachRate",                "AR"),
+    ("SliderMultiplier",            "SV"),
+    ("SliderTickRate",              "SLIDER_TICK_RATE"),
+]
+
+# Must match osu_hash() in the generated source
+def osu_hash(name, k, mask):
+    b = name.encode()
+    n = len(b)
+    return (n * k[0] + b[0] * k[1] + b[n // 2] * k[2] + b[n - 1] * k[3]) & mask
+
+
+def find_parameters(names):
+    rng = random.Random(0)
+    for bits in itertools.count(max(len(names) - 1, 1).bit_length()):
+        mask = (1 << bits) - 1
+        for _ in range(100000):
+            k = [rng.randrange(1, 256) for _ in range(4)]
+            if len({osu_hash(name, k, mask) for name in names}) == len(names):
+                return k, mask
+    raise RuntimeError("unreachable")
+
+
+def emit_table(out, table_name, type_name, prefix, entries):
+    k, mask = find_parameters([name for name, _ in entries])
+    slots = {osu_hash(name, k, mask): (name, suffix) for name, suffix in entries}
+
+    out.append(f"static const osu_name_t {table_name}[{mask + 1}] = {{")
+    for i in range(mask + 1):
+        if i in slots:
+            name, suffix = slots[i]
+            out.append(f'    [{i}] = {{ "{name}", {len(name)}, {prefix}_{suffix} }},')
+    out.append("};")
+    out.append("")
+    out.append(f"{type_name} osu_find_{prefix.lower()}(span_t name) {{")
+    out.append(f"    uint32_t h = osu_hash(name, {k[0]}, {k[1]}, {k[2]}, {k[3]}, {mask});")
+    out.append(f"    return ({type_name})lookup({table_name}, h, name, {prefix}_UNKNOWN);")
+    out.append("}")
+
+
+def main():
+    root = Path(__file__).resolve().parent.parent
+    generated = "/* Generated by tools/gen_osu_keys.py, do not edit. */"
+
+    header = [
+        generated,
+        "#ifndef OSU_KEYS_H",
+        "#define OSU_KEYS_H",
+        "",
+        '#include "lexer.h"',
+        "",
+        "",
+        "/* types */",
+        "typedef enum {",
+        "    SECTION_NULL,  // before the first section header (\"osu file format vXX\")",
+        "    SECTION_UNKNOWN,",
+    ]
+    header += [f"    SECTION_{suffix}," for _, suffix in SECTIONS]
+    header += [
+        "} osu_section_t;",
+        "",
+        "typedef enum {",
+        "    KEY_UNKNOWN,",
+    ]
+    header += [f"    KEY_{suffix}," for _, suffix in KEYS]
+    header += [
+        "} osu_key_t;",
+        "",
+        "",
+        "/* function declarations */",
+        "// Names are compared in full, anything not in the tables is SECTION_UNKNOWN/KEY_UNKNOWN",
+        "osu_section_t   osu_find_section(span_t name);",
+        "osu_key_t       osu_find_key(span_t name);",
+        "",
+        "",
+        "#endif",
+        "",
+    ]
+
+    source = [
+        generated,
+        '#include "osu_keys.h"',
+        "",
+        "#include <stdint.h>",
+        "#include <string.h>",
+        "",
+        "",
+        "/* types */",
+        "typedef struct {",
+        "    const char* name;",
+        "    size_t      length;",
+        "    int         value;",
+        "} osu_name_t;",
+        "",
+        "",
+        "/* local functions */",
+        "static uint32_t osu_hash(span_t s, uint32_t k0, uint32_t k1, uint32_t k2, uint32_t k3, uint32_t mask);",
+        "static int      lookup(const osu_name_t* table, uint32_t h, span_t name, int unknown);",
+        "",
+        "",
+    ]
+    emit_table(source, "SECTIONS", "osu_section_t", "SECTION", SECTIONS)
+    source.append("")
+    emit_table(source, "KEYS", "osu_key_t", "KEY", KEYS)
+    source += [
+        "",
+        "uint32_t osu_hash(span_t s, uint32_t k0, uint32_t k1, uint32_t k2, uint32_t k3, uint32_t mask) {",
+        "    if (s.size == 0)",
+        "        return 0;",
+        "",
+        "    const uint8_t* p = (const uint8_t*)s.data;",
+        "    return ((uint32_t)s.size * k0 + p[0] * k1 + p[s.size / 2] * k2 + p[s.size - 1] * k3) & mask;",
+        "}",
+        "",
+        "int lookup(const osu_name_t* table, uint32_t h, span_t name, int unknown) {",
+        "    // Empty slots have length 0, which no non-empty name matches",
+        "    const osu_name_t* entry = &table[h];",
+        "    if (name.size == 0 || entry->length != name.size || memcmp(entry->name, name.data, name.size) != 0)",
+        "        return unknown;",
+        "    return entry->value;",
+        "}",
+        "",
+    ]
+
+    (root / "src" / "osu_keys.h").write_text("\n".join(header))
+    (root / "src" / "osu_keys.c").write_text("\n".join(source))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
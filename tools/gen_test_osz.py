@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Generates tests/assets/set.osz, the archive the .osz loader and inflater tests
+read.
+
+Every difficulty is stored with a different encoding so the tests reach each
+DEFLATE block type: Easy is not compressed at all, Normal is deflated into stored
+blocks, Insane uses the fixed Huffman codes and Hard dynamic ones. zipfile cannot
+pick the block type, so the archive is written by hand.
+
+Rerun `python3 tools/gen_test_osz.py` from the repository root after changing it
+and commit the regenerated file.
+"""
+
+import struct
+import zlib
+from pathlib import Path
+
+
+SET_ID = 900
+COLUMNS = 4
+
+# (entry name, beatmap id, note count, encoding)
+DIFFICULTIES = [
+    ("Easy.osu",    901, 50,    "zip stored"),
+    ("Normal.osu",  902, 600,   "stored blocks"),
+    ("Hard.osu",    903, 5000,  "dynamic"),
+    ("Insane.osu",  904, 300,   "fixed"),
+]
+
+METHOD_STORED = 0
+METHOD_DEFLATED = 8
+DOS_TIME = 0
+DOS_DATE = (1 << 5) | 1  # 1980-01-01, keeps the output identical across runs
+
+
+def make_osu(version, beatmap_id, note_count):
+    lines = [
+        "osu file format v14",
+        "",
+        "[General]",
+        "AudioFilename: audio.mp3",
+        "PreviewTime: 1000",
+        "Mode: 3",
+        "",
+        "[Metadata]",
+        "Title:Archive",
+        f"Version:{version}",
+        f"BeatmapID:{beatmap_id}",
+        f"BeatmapSetID:{SET_ID}",
+        "",
+        "[Difficulty]",
+        "HPDrainRate:7",
+        f"CircleSize:{COLUMNS}",
+        "OverallDifficulty:8",
+        "",
+        "[TimingPoints]",
+        "0,500,4,2,1,40,1,0",
+        "8000,-50,4,2,1,40,0,0",
+        "",
+        "[HitObjects]",
+    ]
+    for i in range(note_count):
+        x = (i % COLUMNS) * 512 // COLUMNS + 64
+        time = 1000 + i * 125
+        if i % 5 == 4:
+            lines.append(f"{x},192,{time},128,0,{time + 100}:0:0:0:0:")
+        else:
+            lines.append(f"{x},192,{time},1,0,0:0:0:0:")
+    return ("\r\n".join(lines) + "\r\n").encode()
+
+
+def deflate(data, level, strategy):
+    compressor = zlib.compressobj(level, zlib.DEFLATED, -15, 9, strategy)
+    return compressor.compress(data) + compressor.flush()
+
+
+def encode(data, encoding):
+    if encoding == "zip stored":
+        return METHOD_STORED, data
+    if encoding == "stored blocks":
+        return METHOD_DEFLATED, deflate(data, 0, zlib.Z_DEFAULT_STRATEGY)
+    if encoding == "fixed":
+        return METHOD_DEFLATED, deflate(data, 9, zlib.Z_FIXED)
+    return METHOD_DEFLATED, deflate(data, 9, zlib.Z_DEFAULT_STRATEGY)
+
+
+def main():
+    archive = bytearray()
+    central = bytearray()
+
+    for name, beatmap_id, note_count, encoding in DIFFICULTIES:
+        data = make_osu(Path(name).stem, beatmap_id, note_count)
+        method, compressed = encode(data, encoding)
+        crc = zlib.crc32(data)
+        name_bytes = name.encode()
+        offset = len(archive)
+
+        archive += struct.pack("<IHHHHHIIIHH", 0x04034b50, 20, 0, method, DOS_TIME, DOS_DATE,
+                               crc, len(compressed), len(data), len(name_bytes), 0)
+        archive += name_bytes + compressed
+        central += struct.pack("<IHHHHHHIIIHHHHHII", 0x02014b50, 20, 20, 0, method, DOS_TIME, DOS_DATE,
+                               crc, len(compressed), len(data), len(name_bytes), 0, 0, 0, 0, 0, offset)
+        central += name_bytes
+
+    central_offset = len(archive)
+    archive += central
+    archive += struct.pack("<IHHHHIIH", 0x06054b50, 0, 0, len(DIFFICULTIES), len(DIFFICULTIES),
+                           len(central), central_offset, 0)
+
+    Path("tests/assets/set.osz").write_bytes(archive)
+
+
+if __name__ == "__main__":
+    main()